@@ -0,0 +1,329 @@
+#!/usr/bin/env python3
+"""
+netcap.py
+
+Reads a packet capture written by the server's -capture option and breaks the bytes down
+by what they were spent on:
+  - netchan overhead: packet headers, reliable chunk headers, fragment headers
+  - reliable chunks sent again after going unacked
+  - every message in packet_e, with SVC_ENTDELTAS, SVC_PLAYERDELTAS and the sector part
+    of SVC_ENTDELTAS further split by FIELD_*, PFIELD_* and SFIELD_*
+
+Message ids and field sizes are read from src/packets.h, so the decoder follows the protocol
+as long as each field's #define keeps its type in the trailing comment.
+
+Usage:
+  netcap.py capture.bin [--client N] [--series series.csv] [--packets src/packets.h]
+
+--series writes bytes per second for each direction and message type, one row per second.
+"""
+
+import argparse
+import collections
+import os
+import re
+import struct
+import sys
+
+CAPTURE_VERSION = 1
+CAPTURE_OUT = 0x01
+
+# must match netchan.c
+NETCHAN_HEADER = 23 # seq, ack, ackbits, qport, relack, relackbits, nchunks
+FRAGMENT_BIT = 0x80000000
+MORE_BIT = 0x8000
+
+TYPE_SIZES = {
+    "uint8_t": 1, "int8_t": 1,
+    "uint16_t": 2, "int16_t": 2,
+    "uint32_t": 4, "int32_t": 4,
+    "float": 4,
+}
+
+class Protocol:
+    def __init__(self, path):
+        with open(path) as f:
+            text = f.read()
+
+        enum = re.search(r"typedef enum\s*\{(.*?)\}\s*packet_e;", text, re.S)
+        if not enum:
+            sys.exit("%s: no packet_e" % path)
+        self.packets = []
+        for line in enum.group(1).splitlines():
+            m = re.match(r"\s*(\w+)\s*(=\s*\d+)?\s*,", line)
+            if m and m.group(1) != "NUM_PACKETS":
+                self.packets.append(m.group(1))
+
+        # prefix -> [(name, bit, size)] in bit order
+        self.fields = collections.defaultdict(list)
+        for m in re.finditer(r"#define\s+((P|S)?FIELD_\w+)\s+(0x[0-9A-Fa-f]+)\s*//\s*(\w+)", text):
+            prefix = m.group(2) or ""
+            self.fields[prefix].append((m.group(1), int(m.group(3), 16), TYPE_SIZES[m.group(4)]))
+        for prefix in self.fields:
+            self.fields[prefix].sort(key=lambda f: f[1])
+
+        m = re.search(r"#define\s+USERNAME_LEN\s+(\d+)", text)
+        self.usernamelen = int(m.group(1))
+        m = re.search(r"#define\s+SND_HASEDICT\s+(0x[0-9A-Fa-f]+)", text)
+        self.sndhasedict = int(m.group(1), 16)
+
+class Truncated(Exception):
+    pass
+
+class Reader:
+    def __init__(self, data):
+        self.data = data
+        self.pos = 0
+
+    def left(self):
+        return len(self.data) - self.pos
+
+    def take(self, n):
+        if self.pos + n > len(self.data):
+            raise Truncated()
+        b = self.data[self.pos:self.pos + n]
+        self.pos += n
+        return b
+
+    def u8(self):
+        return self.take(1)[0]
+
+    def u16(self):
+        return struct.unpack(">H", self.take(2))[0]
+
+    def u32(self):
+        return struct.unpack(">I", self.take(4))[0]
+
+class Stats:
+    def __init__(self):
+        # (dir, item) -> [count, bytes]
+        self.totals = collections.defaultdict(lambda: [0, 0])
+        # (second, dir, item) -> bytes, messages only
+        self.series = collections.defaultdict(int)
+        self.packets = collections.Counter()
+        self.duration = 0.0
+
+    def add(self, direction, item, nbytes, t=None):
+        entry = self.totals[(direction, item)]
+        entry[0] += 1
+        entry[1] += nbytes
+        if t is not None:
+            self.series[(int(t), direction, item)] += nbytes
+
+# one direction of one client's channel
+class Stream:
+    def __init__(self):
+        self.reset()
+
+    def reset(self):
+        self.nextrel = 1
+        self.pending = {}
+        self.partial = b""
+        self.fragsets = {}
+
+# parts of a message are counted as "MESSAGE/part" and listed under it
+def fieldbytes(proto, stats, direction, parent, prefix, fields, r):
+    for name, bit, size in proto.fields[prefix]:
+        if fields & bit:
+            r.take(size)
+            stats.add(direction, parent + "/" + name, size)
+
+def parsemessages(proto, stats, direction, data, t):
+    r = Reader(data)
+    while r.left():
+        start = r.pos
+        packid = r.u8()
+        name = proto.packets[packid] if packid < len(proto.packets) else "unknown %d" % packid
+        try:
+            parsemessage(proto, stats, direction, name, r)
+        except Truncated:
+            stats.add(direction, "unparsed", len(data) - start, t)
+            return
+        if name.startswith("unknown"):
+            stats.add(direction, "unparsed", len(data) - start, t)
+            return
+        stats.add(direction, name, r.pos - start, t)
+
+def parsemessage(proto, stats, direction, name, r):
+    if name == "CVS_HANDSHAKE":
+        r.take(proto.usernamelen)
+    elif name == "SVC_HANDSHAKE":
+        r.take(4)
+        r.take(13 * r.u16())
+    elif name == "SVC_CHANGELEVEL":
+        r.take(2)
+    elif name == "CSV_INPUT":
+        r.take(4)
+        n = r.u8()
+        r.take(15 * n) # age, flags, angle, switchwpn, frametime, viewms
+        stats.add(direction, name + "/commands", 15 * n)
+    elif name == "SVC_SETPLAYEDICT":
+        r.take(4)
+    elif name == "SVC_SNAPSHOT":
+        r.take(8) # deltaseq, cmdseq
+    elif name == "SVC_PLAYERDELTAS":
+        fieldbytes(proto, stats, direction, name, "P", r.u16(), r)
+        stats.add(direction, name + "/field mask", 2)
+    elif name == "SVC_ENTDELTAS":
+        r.take(4)
+        stats.add(direction, name + "/tic", 4)
+        while True:
+            edict = r.u16()
+            if edict == 0xFFFF:
+                break
+            fieldbytes(proto, stats, direction, name, "", r.u16(), r)
+            stats.add(direction, name + "/edict and mask", 4)
+        while True:
+            sector = r.u16()
+            if sector == 0xFFFF:
+                break
+            fieldbytes(proto, stats, direction, name, "S", r.u8(), r)
+            stats.add(direction, name + "/sector and mask", 3)
+        stats.add(direction, name + "/list ends", 5) # id and two terminators
+    elif name == "SVC_SOUNDEVENTS":
+        n = r.u8()
+        for i in range(n):
+            r.take(5) # seq, sfxid
+            if r.u8() & proto.sndhasedict:
+                r.take(2)
+            else:
+                r.take(8)
+
+def parsepacket(proto, stats, stream, direction, data, t):
+    r = Reader(data)
+    try:
+        seq = r.u32()
+        r.take(NETCHAN_HEADER - 5)
+        nchunks = r.u8()
+    except Truncated:
+        stats.add(direction, "bad packets", len(data))
+        return
+
+    fragment = seq & FRAGMENT_BIT
+    seq &= ~FRAGMENT_BIT
+
+    # a client slot being reused starts over from the first sequence
+    if seq == 1:
+        stream.reset()
+
+    stats.packets[direction] += 1
+    stats.add(direction, "netchan header", NETCHAN_HEADER)
+
+    try:
+        for i in range(nchunks):
+            relseq = r.u32()
+            chunklen = r.u16()
+            more = chunklen & MORE_BIT
+            chunk = r.take(chunklen & ~MORE_BIT)
+            stats.add(direction, "reliable chunk header", 6)
+
+            if relseq < stream.nextrel or relseq in stream.pending:
+                stats.add(direction, "reliable resent", len(chunk), t)
+                continue
+            stream.pending[relseq] = (chunk, more)
+
+        while stream.nextrel in stream.pending:
+            chunk, more = stream.pending.pop(stream.nextrel)
+            stream.nextrel += 1
+            stream.partial += chunk
+            if not more:
+                parsemessages(proto, stats, direction, stream.partial, t)
+                stream.partial = b""
+
+        if fragment:
+            index = r.u8()
+            count = r.u8()
+            stats.add(direction, "fragment header", 2)
+            base = seq - index
+            fragset = stream.fragsets.setdefault(base, {})
+            fragset[index] = r.take(r.left())
+            if len(fragset) == count:
+                parsemessages(proto, stats, direction, b"".join(fragset[i] for i in range(count)), t)
+                del stream.fragsets[base]
+            # sets that never finish aren't worth keeping
+            for old in [b for b in stream.fragsets if b < base - 1024]:
+                del stream.fragsets[old]
+        elif r.left():
+            parsemessages(proto, stats, direction, r.take(r.left()), t)
+    except Truncated:
+        stats.add(direction, "bad packets", len(data) - r.pos)
+
+def readcapture(path, proto, stats, onlyclient):
+    streams = collections.defaultdict(Stream)
+
+    with open(path, "rb") as f:
+        data = f.read()
+
+    if data[:4] != b"NCAP":
+        sys.exit("%s: not a capture" % path)
+    if data[4] != CAPTURE_VERSION:
+        sys.exit("%s: capture version %d, expected %d" % (path, data[4], CAPTURE_VERSION))
+
+    pos = 5
+    while pos + 8 <= len(data):
+        ms, flags, client, length = struct.unpack(">IBBH", data[pos:pos + 8])
+        pos += 8
+        packet = data[pos:pos + length]
+        pos += length
+        if len(packet) < length:
+            break
+
+        if onlyclient is not None and client != onlyclient:
+            continue
+
+        direction = "out" if flags & CAPTURE_OUT else "in"
+        t = ms / 1000.0
+        stats.duration = max(stats.duration, t)
+        stats.add(direction, "total", length)
+        parsepacket(proto, stats, streams[(client, direction)], direction, packet, t)
+
+def report(stats):
+    duration = max(stats.duration, 0.001)
+    for direction in ("out", "in"):
+        total = stats.totals[(direction, "total")][1]
+        if not total:
+            continue
+
+        print("%s: %d packets, %d bytes, %.0f B/s over %.1fs" % (
+            "server -> clients" if direction == "out" else "clients -> server",
+            stats.packets[direction], total, total / duration, duration))
+        print("  %-30s %10s %12s %7s %10s" % ("", "count", "bytes", "share", "B/s"))
+
+        items = sorted([(item, v) for (d, item), v in stats.totals.items() if d == direction and item != "total"],
+            key=lambda i: -i[1][1])
+        for item, (count, nbytes) in items:
+            if "/" in item:
+                continue
+            print("  %-30s %10d %12d %6.1f%% %10.0f" % (item, count, nbytes, 100.0 * nbytes / total, nbytes / duration))
+            for subitem, (subcount, subbytes) in items:
+                if subitem.startswith(item + "/"):
+                    print("    %-28s %10d %12d %6.1f%% %10.0f" % (subitem[len(item) + 1:], subcount, subbytes,
+                        100.0 * subbytes / total, subbytes / duration))
+        print()
+
+def writeseries(stats, path):
+    columns = sorted({(d, item) for (s, d, item) in stats.series})
+    seconds = int(stats.duration) + 1
+    with open(path, "w") as f:
+        f.write("second," + ",".join("%s %s" % c for c in columns) + "\n")
+        for s in range(seconds):
+            f.write("%d," % s + ",".join(str(stats.series.get((s, d, item), 0)) for d, item in columns) + "\n")
+
+def main():
+    parser = argparse.ArgumentParser(description="Break down a server packet capture by message and field")
+    parser.add_argument("capture")
+    parser.add_argument("--client", type=int, help="only this client slot")
+    parser.add_argument("--series", help="write bytes per second per message type to this csv")
+    parser.add_argument("--packets", default=os.path.join(os.path.dirname(os.path.abspath(__file__)), "src", "packets.h"),
+        help="packets.h to take message ids and field sizes from")
+    args = parser.parse_args()
+
+    proto = Protocol(args.packets)
+    stats = Stats()
+    readcapture(args.capture, proto, stats, args.client)
+    report(stats)
+    if args.series:
+        writeseries(stats, args.series)
+
+if __name__ == "__main__":
+    main()
@@ -18,25 +18,52 @@
 #include "render.h"
 #include "snd.h"
 #include "stbar.h"
+#include "svclock.h"
 #include "wad.h"
 
 conn_t serverconn = {};
-float lastrecvtime = -1.0;
+
+// every recent snapshot, since the server's deltas can be from any of them.
+// they're also what entities are interpolated between
+static snapshot_t snapshots[GAMESTATE_WINDOW];
+static int nsnapshots = 0;
+// when the packet being read arrived
+static double recvtime;
+// server tic the snapshot being read was built on
+static int32_t snaptic;
+// the level as loaded, what a deltaseq of 0 is from
+static gamestate_t levelgs = {};
+// the packet being read has a snapshot in it
+static bool gotsnapshot;
+
+static void copygamestate(gamestate_t* dst, const gamestate_t* src)
+{
+    // past maxmobj is empty, same as on the server
+    if(dst->maxmobj > src->maxmobj)
+        memset(&dst->mobjs[src->maxmobj + 1], 0, (dst->maxmobj - src->maxmobj) * sizeof(objinfo_t));
+
+    dst->maxmobj = src->maxmobj;
+    memcpy(dst->mobjs, src->mobjs, (src->maxmobj + 1) * sizeof(objinfo_t));
+    if(dst->sectorinfos && src->sectorinfos)
+        memcpy(dst->sectorinfos, src->sectorinfos, nsectors * sizeof(sectorinfo_t));
+}
 
 static void connect(void)
 {
     netbuf_t buf;
+    uint8_t data[1 + USERNAME_LEN];
     char username[USERNAME_LEN];
 
-    memset(&serverconn.chan, 0, sizeof(netchan_t));
+    netchan_reset(&serverconn.chan);
+    serverconn.cmdack = 0;
+    svclock_reset();
     memset(username, 0, sizeof(username));
     strncpy(username, "player", USERNAME_LEN - 1);
 
-    netbuf_init(&buf);
+    netbuf_initstatic(&buf, data, sizeof(data));
     netbuf_writeu8(&buf, CVS_HANDSHAKE);
     netbuf_writedata(&buf, username, USERNAME_LEN);
     netchan_queue(&serverconn.chan, &buf);
-    netbuf_free(&buf);
 }
 
 static void* recvsetplayedict(void* buf, void* curpos, int len)
@@ -83,8 +110,9 @@ static void* recvsetplayedict(void* buf, void* curpos, int len)
     weapon_initstate(&startwpn);
     player.info.weapon = startwpn;
 
-    for(i = serverconn.chan.inack + 1; i <= serverconn.chan.outseq; i++)
+    for(i = serverconn.cmdack + 1; i <= serverconn.chan.outseq; i++)
         memset(&inputwindow[i % PRED_WINDOW], 0, sizeof(playercmd_t));
+    predict_reset();
 
     return curpos;
 }
@@ -128,34 +156,55 @@ static void* recvsectordeltas(void* buf, void* curpos, int len)
     return curpos;
 }
 
-static void* recvsound(void* buf, void* curpos, int len)
+static void* recvsoundevents(void* buf, void* curpos, int len)
 {
+    int i;
+
+    int n, edict;
+    int32_t seq;
     uint8_t sfxid, flags;
-    int edict;
     float x, y;
 
-    sfxid = net_readu8(buf, curpos++, len);
-    flags = net_readu8(buf, curpos++, len);
+    n = net_readu8(buf, curpos++, len);
     if(netpacketfull)
         return NULL;
-    if(flags & SND_HASEDICT)
-    {
-        edict = net_readu16(buf, curpos, len);
-        curpos += 2;
-        if(netpacketfull)
-            return NULL;
-        if(edict == serverconn.edict && (sfxid == sfx_pistol || sfxid == sfx_shotgn))
-            return curpos;
 
-        snd_playsoundedict(sfxid, edict);
-    }
-    else if(flags & SND_HASPOS)
+    for(i=0; i<n; i++)
     {
-        x = net_readfloat(buf, curpos, len); curpos += 4;
-        y = net_readfloat(buf, curpos, len); curpos += 4;
+        seq = net_readi32(buf, curpos, len);
+        curpos += 4;
+        sfxid = net_readu8(buf, curpos++, len);
+        flags = net_readu8(buf, curpos++, len);
         if(netpacketfull)
             return NULL;
-        snd_playsoundpos(sfxid, x, y);
+
+        // events repeat until the server sees our ack, only play the new ones
+        if(flags & SND_HASEDICT)
+        {
+            edict = net_readu16(buf, curpos, len);
+            curpos += 2;
+            if(netpacketfull)
+                return NULL;
+            if(seq <= serverconn.sndseq)
+                continue;
+            serverconn.sndseq = seq;
+            if(edict == serverconn.edict && (sfxid == sfx_pistol || sfxid == sfx_shotgn))
+                continue;
+
+            snd_playsoundedict(sfxid, edict);
+        }
+        else if(flags & SND_HASPOS)
+        {
+            x = net_readfloat(buf, curpos, len); curpos += 4;
+            y = net_readfloat(buf, curpos, len); curpos += 4;
+            if(netpacketfull)
+                return NULL;
+            if(seq <= serverconn.sndseq)
+                continue;
+            serverconn.sndseq = seq;
+
+            snd_playsoundpos(sfxid, x, y);
+        }
     }
 
     return curpos;
@@ -232,6 +281,11 @@ static void* recvplayerdeltas(void* buf, void* curpos, int len)
         startwpn.time = net_readfloat(buf, curpos, len);
         curpos += 4;
     }
+    if(fields & PFIELD_RNG)
+    {
+        info.rngindex = net_readu8(buf, curpos, len);
+        curpos += 1;
+    }
 
     if(netpacketfull)
         return NULL;
@@ -246,6 +300,19 @@ static void* recventdeltas(void* buf, void* curpos, int len)
     int edict;
     int fields;
     objinfo_t *info;
+    netstats_t *stats;
+    int32_t ack;
+
+    snaptic = net_readi32(buf, curpos, len);
+    curpos += 4;
+    if(netpacketfull)
+        return NULL;
+
+    // the packet this one acks is as close as we have to the round trip that brought it
+    stats = &serverconn.chan.stats;
+    ack = serverconn.chan.inack;
+    if(ack && stats->sendseqs[ack % NETSTATS_TIMES] == ack)
+        svclock_sample(snaptic, stats->sendtimes[ack % NETSTATS_TIMES], recvtime);
 
     while(1)
     {
@@ -344,6 +411,67 @@ static void* recventdeltas(void* buf, void* curpos, int len)
     return recvsectordeltas(buf, curpos, len);
 }
 
+// starts the new gamestate off from the snapshot the deltas that follow are from
+static void* recvsnapshot(void* buf, void* curpos, int len)
+{
+    int i;
+
+    int32_t deltaseq, cmdack;
+    snapshot_t *base;
+
+    deltaseq = net_readi32(buf, curpos, len);
+    curpos += 4;
+    cmdack = net_readi32(buf, curpos, len);
+    curpos += 4;
+    if(netpacketfull)
+        return NULL;
+
+    serverconn.cmdack = cmdack;
+
+    if(!deltaseq)
+    {
+        copygamestate(&newgs, &levelgs);
+        memset(&player.info, 0, sizeof(playerinfo_t));
+        memset(&startwpn, 0, sizeof(wpnst_t));
+        gotsnapshot = true;
+        return curpos;
+    }
+
+    base = NULL;
+    for(i=0; i<GAMESTATE_WINDOW; i++)
+        if(snapshots[i].seq == deltaseq)
+            base = &snapshots[i];
+
+    // the server only deltas from snapshots we acked, so this shouldn't happen
+    if(!base)
+    {
+        fprintf(stderr, "snapshot delta from %d, which we don't have\n", deltaseq);
+        return NULL;
+    }
+
+    copygamestate(&newgs, &base->gs);
+    player.info = base->playstate;
+    startwpn = base->playstate.weapon;
+    gotsnapshot = true;
+
+    return curpos;
+}
+
+// keeps the snapshot just read around for later deltas to be from
+static void storesnapshot(void)
+{
+    snapshot_t *snap;
+
+    snap = &snapshots[nsnapshots++ % GAMESTATE_WINDOW];
+    snap->seq = serverconn.chan.lastseen;
+    snap->time = (double) snaptic / TICRATE;
+    copygamestate(&snap->gs, &newgs);
+    snap->playstate = player.info;
+    snap->playstate.weapon = startwpn;
+
+    interp_addsnapshot(snap->time, recvtime);
+}
+
 static void* recvclev(void* buf, void* curpos, int len)
 {
     int i;
@@ -360,20 +488,31 @@ static void* recvclev(void* buf, void* curpos, int len)
     level_load(e, m);
     mus_start(e, m);
 
-    free(oldgs.sectorinfos);
-    free(newgs.sectorinfos);
-    oldgs.sectorinfos = malloc(nsectors * sizeof(sectorinfo_t));
-    newgs.sectorinfos = malloc(nsectors * sizeof(sectorinfo_t));
+    free(levelgs.sectorinfos);
+    levelgs.sectorinfos = malloc(nsectors * sizeof(sectorinfo_t));
     for(i=0; i<nsectors; i++)
     {
-        oldgs.sectorinfos[i].floorheight = sectors[i].floorheight;
-        oldgs.sectorinfos[i].ceilheight = sectors[i].ceilheight;
-        newgs.sectorinfos[i].floorheight = sectors[i].floorheight;
-        newgs.sectorinfos[i].ceilheight = sectors[i].ceilheight;
+        levelgs.sectorinfos[i].floorheight = sectors[i].floorheight;
+        levelgs.sectorinfos[i].ceilheight = sectors[i].ceilheight;
     }
 
+    levelgs.maxmobj = mobjmax;
     for(i=0; i<=mobjmax; i++)
-        oldgs.mobjs[i] = newgs.mobjs[i] = mobjs[i].info;
+        levelgs.mobjs[i] = mobjs[i].info;
+
+    free(newgs.sectorinfos);
+    newgs.sectorinfos = malloc(nsectors * sizeof(sectorinfo_t));
+    copygamestate(&newgs, &levelgs);
+
+    for(i=0; i<GAMESTATE_WINDOW; i++)
+    {
+        free(snapshots[i].gs.sectorinfos);
+        snapshots[i].gs.sectorinfos = malloc(nsectors * sizeof(sectorinfo_t));
+        snapshots[i].seq = 0;
+    }
+    nsnapshots = 0;
+    predict_reset();
+    interp_reset();
 
     return curpos;
 }
@@ -391,6 +530,7 @@ static void* recvshake(void* buf, void* curpos, int len)
         return NULL;
 
     serverconn.edict = -1;
+    serverconn.sndseq = 0;
 
     nwads = net_readi16(buf, curpos, len);
     curpos += 2;
@@ -425,14 +565,17 @@ static void* recvshake(void* buf, void* curpos, int len)
     return curpos;
 }
 
-static void recvpacket(void *buf, int len)
+static void recvpacket(void *packet, int packetlen)
 {
-    void *curpos;
+    void *buf, *curpos;
+    int len;
     uint8_t packid;
 
-    curpos = netchan_recv(&serverconn.chan, buf, len);
-    if(!curpos)
+    buf = netchan_recv(&serverconn.chan, packet, packetlen, &len);
+    if(!buf)
         return;
+    curpos = buf;
+    gotsnapshot = false;
 
     while(1)
     {
@@ -463,8 +606,8 @@ static void recvpacket(void *buf, int len)
             if(!(curpos = recvplayerdeltas(buf, curpos, len)))
                 return;
             break;
-        case SVC_SOUND:
-            if(!(curpos = recvsound(buf, curpos, len)))
+        case SVC_SOUNDEVENTS:
+            if(!(curpos = recvsoundevents(buf, curpos, len)))
                 return;
             break;
         case SVC_SETPLAYEDICT:
@@ -474,52 +617,97 @@ static void recvpacket(void *buf, int len)
         case SVC_PICKUP:
             player.pickupcnt += 6;
             break;
+        case SVC_SNAPSHOT:
+            if(!(curpos = recvsnapshot(buf, curpos, len)))
+                return;
+            break;
         default:
             fprintf(stderr, "bad packet id %d from server\n", packid);
             return;
         }
     }
+
+    if(gotsnapshot)
+        storesnapshot();
 }
 
-void recvfromserver(float curtime)
+void recvfromserver(double curtime)
 {
-    uint8_t buf[NET_MAX_PACKET_SIZE];
+    void *packet;
     int len;
-    bool received;
-    sectorinfo_t *oldsectors;
 
-    received = false;
-    while((len = net_recv(buf, sizeof(buf), NULL)) > 0)
+    recvtime = curtime;
+    while((packet = net_recvinplace(&len, NULL)))
+    {
+        recvpacket(packet, len);
+        net_recvrelease();
+    }
+}
+
+void findsnapshots(double t, const snapshot_t** from, const snapshot_t** to)
+{
+    int i;
+
+    *from = *to = NULL;
+    for(i=0; i<GAMESTATE_WINDOW; i++)
     {
-        if(!received)
+        if(!snapshots[i].seq)
+            continue;
+
+        if(snapshots[i].time <= t)
         {
-            oldsectors = oldgs.sectorinfos;
-            memcpy(&oldgs, &newgs, sizeof(gamestate_t));
-            oldgs.sectorinfos = oldsectors;
-            if(oldsectors && newgs.sectorinfos)
-                memcpy(oldsectors, newgs.sectorinfos, nsectors * sizeof(sectorinfo_t));
-            received = true;
+            if(!*from || snapshots[i].time > (*from)->time)
+                *from = &snapshots[i];
         }
-        lastrecvtime = curtime;
-        recvpacket(buf, len);
+        else if(!*to || snapshots[i].time < (*to)->time)
+            *to = &snapshots[i];
     }
 }
 
+static void putcmd(netbuf_t* buf, const playercmd_t* cmd, int age)
+{
+    netbuf_putu8(buf, age);
+    netbuf_putu8(buf, cmd->flags);
+    netbuf_putu32(buf, cmd->angle);
+    netbuf_putu8(buf, cmd->switchwpn);
+    netbuf_putfloat(buf, cmd->frametime);
+    netbuf_putu32(buf, cmd->viewms);
+}
+
+// the new command goes out with the last few the server hasn't run, so losing a packet
+// doesn't lose its input. commands are numbered by the packet they first went out in
 void buildunreliable(netbuf_t* buf)
 {
+    int i;
+
+    int32_t seq;
+    int32_t resend[CMD_REDUNDANCY - 1];
+    int nresend;
+
     if(!sendinputs)
         return;
-    netbuf_writeu8(buf, CSV_INPUT);
-    netbuf_writeu8(buf, inputcmd.flags);
-    netbuf_writeu32(buf, inputcmd.angle);
-    netbuf_writeu8(buf, inputcmd.switchwpn);
-    netbuf_writefloat(buf, inputcmd.frametime);
+
+    seq = serverconn.chan.outseq + 1;
+    nresend = 0;
+    for(i=seq-1; i>serverconn.cmdack && seq-i<=255 && nresend<CMD_REDUNDANCY-1; i--)
+        if(inputwindow[i % PRED_WINDOW].frametime)
+            resend[nresend++] = i;
+
+    if(!netbuf_reserve(buf, 1 + 4 + 1 + (nresend + 1) * (1 + 1 + 4 + 1 + 4 + 4)))
+        return;
+    netbuf_putu8(buf, CSV_INPUT);
+    netbuf_putu32(buf, seq);
+    netbuf_putu8(buf, nresend + 1);
+    for(i=nresend-1; i>=0; i--)
+        putcmd(buf, &inputwindow[resend[i] % PRED_WINDOW], seq - resend[i]);
+    putcmd(buf, &inputcmd, 0);
 }
 
 void sendtoserver(void)
 {
     double now;
     netbuf_t buf;
+    uint8_t data[MAX_CHUNK];
 
     if(!net_connected())
     {
@@ -549,10 +737,9 @@ void sendtoserver(void)
 
     if(serverconn.state != CLSTATE_DC)
     {
-        netbuf_init(&buf);
+        netbuf_initstatic(&buf, data, sizeof(data));
         buildunreliable(&buf);
         netchan_send(&serverconn.chan, net_server_dc(), &buf);
-        netbuf_free(&buf);
 
         if(sendinputs)
             inputwindow[serverconn.chan.outseq % PRED_WINDOW] = inputcmd;
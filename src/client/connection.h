@@ -5,6 +5,7 @@
 
 #include "netchan.h"
 #include "packets.h"
+#include "player.h"
 
 typedef enum
 {
@@ -19,14 +20,25 @@ typedef struct
     clstate_e state;
     int32_t clientid;
     int32_t edict;
+    int32_t sndseq; // newest sound event played
+    int32_t cmdack; // newest command the server had run, as of the newest snapshot
     double shaketimer;
     double nextattempt;
 } conn_t;
 
+typedef struct
+{
+    int32_t seq; // 0 if the slot is empty
+    double time; // server time of the tic it was built on
+    gamestate_t gs;
+    playerinfo_t playstate;
+} snapshot_t;
+
 extern conn_t serverconn;
-extern float lastrecvtime;
 
-void recvfromserver(float clocktime);
+void recvfromserver(double clocktime);
 void sendtoserver(void);
+// the newest received snapshot at or before time t and the oldest after it, either can be NULL
+void findsnapshots(double t, const snapshot_t** from, const snapshot_t** to);
 
 #endif
@@ -42,21 +42,21 @@ clgamestate_e curgs = CLGS_MAINMENU, pendgs = CLGS_NONE;
 void douse(void)
 {
     netbuf_t netbuf;
+    uint8_t data[1];
 
-    netbuf_init(&netbuf);
+    netbuf_initstatic(&netbuf, data, sizeof(data));
     netbuf_writeu8(&netbuf, CSV_USE);
     netchan_queue(&serverconn.chan, &netbuf);
-    netbuf_free(&netbuf);
 }
 
 void dorespawn(void)
 {
     netbuf_t netbuf;
+    uint8_t data[1];
 
-    netbuf_init(&netbuf);
+    netbuf_initstatic(&netbuf, data, sizeof(data));
     netbuf_writeu8(&netbuf, CSV_RESPAWN);
     netchan_queue(&serverconn.chan, &netbuf);
-    netbuf_free(&netbuf);
 }
 
 bool uselastframe = false;
@@ -108,7 +108,7 @@ void gatherinput(void)
 
 float lastplayerz = INFINITY, playerz;
 
-static void display(float frametime, float curtime, float progtime)
+static void display(float frametime, double curtime, float progtime)
 {
     switch(curgs)
     {
@@ -122,8 +122,10 @@ static void display(float frametime, float curtime, float progtime)
         gatherinput();
 
         predictplayer();
-        interpsectors(curtime / 1000.0);
-        interpentities(curtime / 1000.0);
+        interp_update(curtime / 1000.0);
+        interpsectors();
+        interpentities();
+        inputcmd.viewms = interp_viewms();
 
         weaponprediction = false;
         player_docmd(&player, &inputcmd);
@@ -167,8 +169,9 @@ void loop(void)
 
     if(curtime - lastfpscheck > 1000)
     {
-        printf("%d fps\n", fpsframes);
+        printf("%d fps, %d mispredictions, %d commands resimulated\n", fpsframes, predict_misses, predict_resims);
         fpsframes = 0;
+        predict_misses = predict_resims = 0;
         lastfpscheck = curtime;
     }
 
@@ -4,41 +4,68 @@
 #include <stdint.h>
 #include <stdio.h>
 
-// ---- Receive queue ----
+// ---- Receive ring ----
 // Emscripten (without -pthread) is single-threaded: both the game loop and the
 // WebRTC onmessage callback run on the browser's main thread, so no mutex is needed.
-
-#define NET_QUEUE_LEN 64
-
-typedef struct {
-    uint8_t data[NET_MAX_PACKET_SIZE];
-    int     size;
-} net_packet_t;
-
-static net_packet_t recv_queue[NET_QUEUE_LEN];
-static int          queue_head  = 0;
-static int          queue_tail  = 0;
-static int          queue_count = 0;
+//
+// Packets are written by JS straight into a byte ring, each as a 4 byte length then
+// the packet padded to 4 bytes. Packets never straddle the end: when one doesn't fit
+// there it goes at the start and the ring wraps at wrap_at.
+
+#define NET_RING_SIZE (512 * 1024)
+#define NET_RECORD_SIZE(size) (4 + (((size) + 3) & ~3))
+
+static uint8_t ring[NET_RING_SIZE] __attribute__((aligned(4)));
+static int     ring_head  = 0; // oldest packet
+static int     ring_tail  = 0; // where the next one goes
+static int     ring_count = 0;
+static bool    wrapped    = false; // packets run from head to wrap_at, then from 0 to tail
+static int     wrap_at    = 0;
+static int     reserved   = -1; // where net_reserve put the packet it handed out
 
 // Integer handle for the server's data channel (set by net_set_dc, called from JS).
 static int server_dc = 0;
 
 // ---- Called from JavaScript when a packet arrives on the data channel ----
-// pre.js calls: Module._net_push_packet(ptr, size)
+// pre.js copies the packet to the pointer net_reserve returns, then calls net_commit.
+// Returns NULL if the ring is too full and the packet has to be dropped.
+
+EMSCRIPTEN_KEEPALIVE
+void *net_reserve(int size)
+{
+    int need = NET_RECORD_SIZE(size);
+
+    reserved = -1;
+    if (size <= 0 || size > NET_MAX_PACKET_SIZE) return NULL;
+
+    if (wrapped) {
+        if (ring_head - ring_tail >= need) reserved = ring_tail;
+    } else if (NET_RING_SIZE - ring_tail >= need) {
+        reserved = ring_tail;
+    } else if (ring_head >= need) {
+        reserved = 0;
+    }
+
+    if (reserved < 0) {
+        printf("[net] recv ring full, dropping packet\n");
+        return NULL;
+    }
+    return ring + reserved + 4;
+}
 
 EMSCRIPTEN_KEEPALIVE
-void net_push_packet(const void *data, int size)
+void net_commit(int size)
 {
-    if (size <= 0 || size > NET_MAX_PACKET_SIZE) return;
-    if (queue_count >= NET_QUEUE_LEN) {
-        printf("[net] recv queue full, dropping packet\n");
-        return;
+    if (reserved < 0) return;
+
+    if (reserved != ring_tail) {
+        wrap_at = ring_tail;
+        wrapped = true;
     }
-    net_packet_t *slot = &recv_queue[queue_tail];
-    memcpy(slot->data, data, size);
-    slot->size  = size;
-    queue_tail  = (queue_tail + 1) % NET_QUEUE_LEN;
-    queue_count++;
+    *(int32_t *) (ring + reserved) = size;
+    ring_tail = reserved + NET_RECORD_SIZE(size);
+    ring_count++;
+    reserved = -1;
 }
 
 // Called from JS when the WebRTC data channel to the server opens.
@@ -55,11 +82,16 @@ void net_set_dc(int id)
 EM_JS(int, js_net_send, (int dc, const void *data, int size), {
     var ch = (Module._netDataChannels || {})[dc];
     if (!ch || ch.readyState !== 'open') return -1;
-    // slice creates an independent ArrayBuffer copy so the C stack frame can return safely
-    ch.send(HEAPU8.buffer.slice(data, data + size));
+    // send copies the bytes before returning, so a view of the heap is enough
+    ch.send(HEAPU8.subarray(data, data + size));
     return size;
 });
 
+EM_JS(int, js_net_buffered, (int dc), {
+    var ch = (Module._netDataChannels || {})[dc];
+    return ch ? ch.bufferedAmount : 0;
+});
+
 EM_JS(int, js_net_connected, (int dc), {
     var ch = (Module._netDataChannels || {})[dc];
     return (ch && ch.readyState === 'open') ? 1 : 0;
@@ -72,25 +104,57 @@ void net_init(void)
     printf("[net] client net ready (call connectToGame() from JS to connect)\n");
 }
 
+double net_time(void)
+{
+    return emscripten_get_now() / 1000.0;
+}
+
 int net_send(int dc, const void *data, int size)
 {
     return js_net_send(dc, data, size);
 }
 
+int net_buffered(int dc)
+{
+    return js_net_buffered(dc);
+}
+
 int net_recv_pending(void)
 {
-    return queue_count;
+    return ring_count;
 }
 
-int net_recv(void *buf, int buf_size, int *dc_out)
+void *net_recvinplace(int *size_out, int *dc_out)
 {
-    if (queue_count == 0) return 0;
-    net_packet_t *slot = &recv_queue[queue_head];
-    int copy = slot->size < buf_size ? slot->size : buf_size;
-    memcpy(buf, slot->data, copy);
+    if (ring_count == 0) return NULL;
+    *size_out = *(int32_t *) (ring + ring_head);
     if (dc_out) *dc_out = server_dc;
-    queue_head  = (queue_head + 1) % NET_QUEUE_LEN;
-    queue_count--;
+    return ring + ring_head + 4;
+}
+
+void net_recvrelease(void)
+{
+    if (ring_count == 0) return;
+    ring_head += NET_RECORD_SIZE(*(int32_t *) (ring + ring_head));
+    ring_count--;
+
+    if (ring_count == 0) {
+        ring_head = ring_tail = 0;
+        wrapped = false;
+    } else if (wrapped && ring_head == wrap_at) {
+        ring_head = 0;
+        wrapped = false;
+    }
+}
+
+int net_recv(void *buf, int buf_size, int *dc_out)
+{
+    int size;
+    void *data = net_recvinplace(&size, dc_out);
+    if (!data) return 0;
+    int copy = size < buf_size ? size : buf_size;
+    memcpy(buf, data, copy);
+    net_recvrelease();
     return copy;
 }
 
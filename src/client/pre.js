@@ -77,12 +77,12 @@ globalThis.connectToGame = async function connectToGame(ip, port) {
             Module._net_set_dc(DC_ID);
         };
         dataChannel.onmessage = (event) => {
+            // straight into the wasm receive ring, C reads it from there
             const bytes = new Uint8Array(event.data);
-            const sp = stackSave();
-            const ptr = stackAlloc(bytes.length);
+            const ptr = Module._net_reserve(bytes.length);
+            if (!ptr) return;
             HEAPU8.set(bytes, ptr);
-            Module._net_push_packet(ptr, bytes.length);
-            stackRestore(sp);
+            Module._net_commit(bytes.length);
         };
 
         // 4. Create and send the Offer
@@ -0,0 +1,171 @@
+#include "prederr.h"
+
+#include <emscripten.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "player.h"
+
+typedef struct
+{
+    int32_t seq;
+    uint8_t paths;
+    bool miss, weapon;
+    float poserr, velerr;
+} prederrcheck_t;
+
+static const float bounds[PREDERR_BUCKETS - 1] = { 1.0 / 64, 1.0 / 16, 0.25, 1, 4, 16, 64 };
+static const char *pathnames[NUM_PATHS] = { "slide", "slidemobj", "pickup", "trigger", "air", "mover" };
+
+static int hits, misses, weaponmisses;
+static int poshist[PREDERR_BUCKETS], velhist[PREDERR_BUCKETS];
+// acked commands through each path, and those of them in a run that ended in a miss
+static int pathcmds[NUM_PATHS], pathmisses[NUM_PATHS];
+
+// paths of every command since the last the server agreed with
+static uint8_t suspect;
+static int32_t lastgood;
+static bool diverged;
+
+static bool tracing;
+static prederrcheck_t trace[PREDERR_TRACE];
+static int ntrace;
+
+static int prederr_bucket(float err)
+{
+    int i;
+
+    for(i=0; i<PREDERR_BUCKETS-1 && err>=bounds[i]; i++);
+    return i;
+}
+
+static void prederr_record(int32_t seq, bool miss, float poserr, float velerr, bool weapon)
+{
+    prederrcheck_t *check;
+
+    if(!tracing)
+        return;
+
+    check = &trace[ntrace++ % PREDERR_TRACE];
+    check->seq = seq;
+    check->paths = suspect;
+    check->miss = miss;
+    check->weapon = weapon;
+    check->poserr = poserr;
+    check->velerr = velerr;
+}
+
+static void prederr_printpaths(uint8_t paths)
+{
+    int i;
+
+    if(!paths)
+    {
+        printf("none");
+        return;
+    }
+
+    for(i=0; i<NUM_PATHS; i++)
+    {
+        if(!(paths & (1 << i)))
+            continue;
+        paths &= ~(1 << i);
+        printf("%s%s", pathnames[i], paths ? "+" : "");
+    }
+}
+
+void prederr_command(uint8_t paths)
+{
+    int i;
+
+    for(i=0; i<NUM_PATHS; i++)
+    {
+        if(paths & (1 << i))
+            pathcmds[i]++;
+    }
+
+    suspect |= paths;
+}
+
+void prederr_hit(int32_t seq)
+{
+    hits++;
+    prederr_record(seq, false, 0, 0, false);
+
+    suspect = 0;
+    lastgood = seq;
+    diverged = false;
+}
+
+void prederr_miss(int32_t seq, float poserr, float velerr, bool weapon)
+{
+    int i;
+
+    misses++;
+    if(weapon)
+        weaponmisses++;
+    poshist[prederr_bucket(poserr)]++;
+    velhist[prederr_bucket(velerr)]++;
+    for(i=0; i<NUM_PATHS; i++)
+    {
+        if(suspect & (1 << i))
+            pathmisses[i]++;
+    }
+    prederr_record(seq, true, poserr, velerr, weapon);
+
+    // after the first miss everything is off by the same mistake until the server agrees again
+    if(!diverged)
+    {
+        printf("prediction diverged after command %d, by command %d: %.4f units, %.4f units/s%s, paths ",
+            lastgood, seq, poserr, velerr, weapon ? ", weapon" : "");
+        prederr_printpaths(suspect);
+        printf("\n");
+    }
+    diverged = true;
+
+    suspect = 0;
+}
+
+EMSCRIPTEN_KEEPALIVE
+void prederr_dump(void)
+{
+    int i, first;
+
+    prederrcheck_t *check;
+
+    printf("%d predictions checked, %d missed, %d of them on the weapon\n", hits + misses, misses, weaponmisses);
+
+    printf("%-12s %10s %10s\n", "error", "position", "velocity");
+    for(i=0; i<PREDERR_BUCKETS; i++)
+    {
+        if(i < PREDERR_BUCKETS - 1)
+            printf("< %-10g %10d %10d\n", bounds[i], poshist[i], velhist[i]);
+        else
+            printf(">= %-9g %10d %10d\n", bounds[i - 1], poshist[i], velhist[i]);
+    }
+
+    printf("%-12s %10s %10s\n", "path", "commands", "misses");
+    for(i=0; i<NUM_PATHS; i++)
+        printf("%-12s %10d %10d\n", pathnames[i], pathcmds[i], pathmisses[i]);
+
+    if(!tracing)
+        return;
+
+    printf("seq,miss,poserr,velerr,weapon,paths\n");
+    first = ntrace > PREDERR_TRACE ? ntrace - PREDERR_TRACE : 0;
+    for(i=first; i<ntrace; i++)
+    {
+        check = &trace[i % PREDERR_TRACE];
+        printf("%d,%d,%g,%g,%d,", check->seq, check->miss, check->poserr, check->velerr, check->weapon);
+        prederr_printpaths(check->paths);
+        printf("\n");
+    }
+}
+
+EMSCRIPTEN_KEEPALIVE
+void prederr_trace(int on)
+{
+    tracing = on;
+    ntrace = 0;
+    memset(trace, 0, sizeof(trace));
+}
@@ -0,0 +1,23 @@
+#ifndef _PREDERR_H
+#define _PREDERR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// errors are counted in buckets 4x apart, the first is under 1/64 and the last 64 or more
+#define PREDERR_BUCKETS 8
+// checks kept by the trace
+#define PREDERR_TRACE 1024
+
+// every acked command once, with the PATH_XX it went through when predicted
+void prederr_command(uint8_t paths);
+// the server agreed with the prediction for command seq
+void prederr_hit(int32_t seq);
+// it didn't. poserr in units, velerr in units per second
+void prederr_miss(int32_t seq, float poserr, float velerr, bool weapon);
+// prints the histograms, the miss rate per path and the trace if it's on
+void prederr_dump(void);
+// keep the last PREDERR_TRACE checks for the dump
+void prederr_trace(int on);
+
+#endif
@@ -1,108 +1,399 @@
 #include "predict.h"
 
+#include <math.h>
 #include <string.h>
 
 #include "connection.h"
+#include "prederr.h"
+#include "svclock.h"
 #include "visweapon.h"
 
+// the player as it was predicted to be after a command
+typedef struct
+{
+    int32_t seq; // the command, 0 if the slot is empty
+    objinfo_t info;
+    wpnst_t weapon;
+    playercmd_t lastcmd;
+    uint8_t rngindex;
+    uint8_t paths;
+} predstate_t;
+
 playercmd_t inputwindow[PRED_WINDOW] = {};
-gamestate_t oldgs = {};
 gamestate_t newgs = {};
 wpnst_t startwpn = {};
 
+int predict_misses = 0;
+int predict_resims = 0;
+
+static predstate_t predstates[PRED_WINDOW];
+// newest command in predstates. the states from the last resimulation up to it follow on from each other
+static int32_t predicted = 0;
+// newest acked command compared with the server
+static int32_t checked = 0;
+
+// the playout clock runs interpdelay behind the server's, which covers how long snapshots
+// take to get here and enough of a buffer that there's usually one either side of it
+static double lastsnaptime = 0;
+static float snapinterval = 1.0 / TICRATE, snapjitter = 0, snaplatency = 0;
+static float interpdelay = INTERP_MINDELAY;
+static double playtime = 0, lastabstime = 0;
+
+// what this frame is between. interpfrac is how far from one to the other,
+// or without an interpto how long past interpfrom to extrapolate
+static const snapshot_t *interpfrom = NULL, *interpto = NULL;
+static float interpfrac;
+
+// the snapshots entities were last brought up to, 0 to bring them all up to date next frame.
+// only the entities in moving change from frame to frame between them
+static int32_t appliedfrom = 0, appliedto = 0;
+static int nmoving = 0;
+static int moving[MAX_MOBJ];
+
+void predict_reset(void)
+{
+    memset(predstates, 0, sizeof(predstates));
+    predicted = checked = 0;
+    appliedfrom = appliedto = 0;
+}
+
+// whether the server ended up where we predicted we would be after command seq.
+// state isn't compared, it's animation and nothing we predict depends on it
+static bool predict_matches(int32_t seq)
+{
+    predstate_t *pred;
+    objinfo_t *server;
+
+    pred = &predstates[seq % PRED_WINDOW];
+    server = &newgs.mobjs[serverconn.edict];
+
+    if(!seq || pred->seq != seq)
+        return false;
+
+    return pred->info.exists == server->exists
+    && pred->info.x == server->x && pred->info.y == server->y && pred->info.z == server->z
+    && pred->info.xvel == server->xvel && pred->info.yvel == server->yvel && pred->info.zvel == server->zvel
+    && pred->info.angle == server->angle
+    && pred->info.health == server->health
+    && pred->info.flags == server->flags
+    && pred->info.height == server->height
+    && pred->weapon.state == startwpn.state
+    && pred->weapon.cur == startwpn.cur
+    && pred->weapon.pend == startwpn.pend
+    && pred->weapon.time == startwpn.time;
+}
+
+// predict_matches, and the first time for each ack, how far off we were for prederr
+static bool predict_check(int32_t seq)
+{
+    int32_t i;
+    bool match, wpnerr;
+    float dx, dy, dz;
+    float poserr, velerr;
+
+    predstate_t *pred;
+    objinfo_t *server;
+
+    match = predict_matches(seq);
+    if(seq <= checked)
+        return match;
+
+    for(i=MAX(checked+1, seq-PRED_WINDOW+1); i<=seq; i++)
+    {
+        if(predstates[i % PRED_WINDOW].seq == i)
+            prederr_command(predstates[i % PRED_WINDOW].paths);
+    }
+    checked = seq;
+
+    pred = &predstates[seq % PRED_WINDOW];
+    server = &newgs.mobjs[serverconn.edict];
+    if(pred->seq != seq)
+        return match;
+
+    if(match)
+    {
+        prederr_hit(seq);
+        return match;
+    }
+
+    dx = pred->info.x - server->x;
+    dy = pred->info.y - server->y;
+    dz = pred->info.z - server->z;
+    poserr = sqrtf(dx * dx + dy * dy + dz * dz);
+    dx = pred->info.xvel - server->xvel;
+    dy = pred->info.yvel - server->yvel;
+    dz = pred->info.zvel - server->zvel;
+    velerr = sqrtf(dx * dx + dy * dy + dz * dz);
+
+    wpnerr = pred->weapon.state != startwpn.state || pred->weapon.cur != startwpn.cur
+    || pred->weapon.pend != startwpn.pend || pred->weapon.time != startwpn.time;
+
+    prederr_miss(seq, poserr, velerr, wpnerr);
+    return match;
+}
+
+// only commands the server hasn't seen yet need simulating. their results are kept, so while
+// the server keeps agreeing with us each frame only simulates the commands sent since the last
 void predictplayer(void)
 {
     int i;
     int start, end;
-    wpnst_t savewpn;
-
-    player.info.weapon = startwpn;
 
-    level_unplacemobj(&mobjs[serverconn.edict]);
-    mobjs[serverconn.edict].info = newgs.mobjs[serverconn.edict];
-    level_placemobj(&mobjs[serverconn.edict]);
+    playercmd_t *cmd;
+    predstate_t *pred;
 
-    start = serverconn.chan.inack + 1;
+    start = serverconn.cmdack + 1;
     end = serverconn.chan.outseq;
 
-    if(end - start >= PRED_WINDOW)
+    // the acked command's slot has to survive the loop below
+    if(end - start >= PRED_WINDOW - 1)
         return;
 
+    level_unplacemobj(&mobjs[serverconn.edict]);
+    if(predict_check(start - 1))
+    {
+        pred = &predstates[predicted % PRED_WINDOW];
+        mobjs[serverconn.edict].info = pred->info;
+        player.info.weapon = pred->weapon;
+        player.lastcmd = pred->lastcmd;
+        player.info.rngindex = pred->rngindex;
+        start = predicted + 1;
+    }
+    else
+    {
+        // only a wrong guess if there was one, not when there's nothing predicted that far yet
+        if(start > 1 && predstates[(start - 1) % PRED_WINDOW].seq == start - 1)
+            predict_misses++;
+        predict_resims += MAX(predicted - start + 1, 0);
+
+        mobjs[serverconn.edict].info = newgs.mobjs[serverconn.edict];
+        player.info.weapon = startwpn;
+        cmd = &inputwindow[(start - 1) % PRED_WINDOW];
+        if(cmd->frametime)
+            player.lastcmd = *cmd;
+
+        // the server's state is the prediction for its ack from now on, so the frames
+        // until the next ack go on from here instead of simulating everything again
+        if(start > 1)
+        {
+            pred = &predstates[(start - 1) % PRED_WINDOW];
+            pred->seq = start - 1;
+            pred->info = mobjs[serverconn.edict].info;
+            pred->weapon = player.info.weapon;
+            pred->lastcmd = player.lastcmd;
+            pred->rngindex = player.info.rngindex;
+        }
+    }
+    level_placemobj(&mobjs[serverconn.edict]);
+
     curwpnplayer = &player;
 
     weaponprediction = true;
     for(i=start; i<=end; i++)
     {
-        player.lastcmd = inputwindow[i % PRED_WINDOW];
-        player_docmd(&player, &inputwindow[i % PRED_WINDOW]);
-        weapon_tickstate(&player.info.weapon, inputwindow[i % PRED_WINDOW].frametime);
+        cmd = &inputwindow[i % PRED_WINDOW];
+
+        // packets that went without input carry no command for the server to run
+        if(cmd->frametime)
+        {
+            player.lastcmd = *cmd;
+            player_docmd(&player, cmd);
+            weapon_tickstate(&player.info.weapon, cmd->frametime);
+        }
+
+        pred = &predstates[i % PRED_WINDOW];
+        pred->seq = i;
+        pred->info = mobjs[serverconn.edict].info;
+        pred->weapon = player.info.weapon;
+        pred->lastcmd = player.lastcmd;
+        pred->rngindex = player.info.rngindex;
+        pred->paths = cmd->frametime ? player.paths : 0;
+    }
+    predicted = end;
+}
+
+void interp_addsnapshot(double snaptime, double arrival)
+{
+    float late, buffer;
+
+    if(!svclock_synced)
+        return;
+
+    late = svclock_time(arrival) - snaptime;
+    if(!lastsnaptime)
+    {
+        snaplatency = late;
+        interpdelay = late + INTERP_MINDELAY;
+        lastsnaptime = snaptime;
+        return;
     }
+
+    if(snaptime > lastsnaptime)
+        snapinterval += (snaptime - lastsnaptime - snapinterval) / 16;
+    snapjitter += (fabsf(late - snaplatency) - snapjitter) / 16;
+    snaplatency += (late - snaplatency) / 16;
+    lastsnaptime = MAX(lastsnaptime, snaptime);
+
+    // enough of a buffer that the next snapshot is usually in before it's needed
+    buffer = snapinterval + 2 * snapjitter;
+    buffer = CLAMP(buffer, INTERP_MINDELAY, INTERP_MAXDELAY);
+    interpdelay += (snaplatency + buffer - interpdelay) / 8;
 }
 
-void interpent(float t, int edict)
+void interp_reset(void)
 {
-    objinfo_t *obj, *old, *new;
+    lastsnaptime = 0;
+    playtime = 0;
+    interpfrom = interpto = NULL;
+    appliedfrom = appliedto = 0;
+}
+
+int32_t interp_viewms(void)
+{
+    return playtime * 1000;
+}
+
+void interp_update(double abstime)
+{
+    double target;
+    float dt, slew;
+
+    dt = abstime - lastabstime;
+    lastabstime = abstime;
+
+    if(!lastsnaptime)
+        return;
+
+    target = svclock_time(abstime) - interpdelay;
+    if(!playtime || fabs(target - playtime) > INTERP_MAXDRIFT)
+        playtime = target;
+    else
+    {
+        slew = CLAMP((target - playtime) * 2, -INTERP_SLEW, INTERP_SLEW);
+        playtime += dt * (1 + slew);
+    }
+
+    findsnapshots(playtime, &interpfrom, &interpto);
+    if(!interpfrom)
+    {
+        interpfrom = interpto;
+        interpto = NULL;
+        interpfrac = 0;
+    }
+    else if(interpto)
+        interpfrac = (playtime - interpfrom->time) / (interpto->time - interpfrom->time);
+    else
+        interpfrac = MIN(playtime - interpfrom->time, INTERP_MAXEXTRAP);
+}
+
+static void interpent(int edict)
+{
+    objinfo_t *obj;
+    const objinfo_t *old, *new;
 
     obj = &mobjs[edict].info;
-    old = &oldgs.mobjs[edict];
-    new = &newgs.mobjs[edict];
+    old = &interpfrom->gs.mobjs[edict];
 
-    *obj = *new;
-    obj->x = LERP(old->x, new->x, t);
-    obj->y = LERP(old->y, new->y, t);
-    obj->z = LERP(old->z, new->z, t);
+    // nothing newer yet, keep it going the way it was
+    if(!interpto)
+    {
+        *obj = *old;
+        obj->x += old->xvel * interpfrac;
+        obj->y += old->yvel * interpfrac;
+    }
+    else
+    {
+        new = &interpto->gs.mobjs[edict];
+        *obj = *new;
+        obj->x = LERP(old->x, new->x, interpfrac);
+        obj->y = LERP(old->y, new->y, interpfrac);
+        obj->z = LERP(old->z, new->z, interpfrac);
+    }
 
-    level_unplacemobj(&mobjs[edict]);
-    level_placemobj(&mobjs[edict]);
+    level_relinkmobj(&mobjs[edict]);
 }
 
-void interpsectors(float abstime)
+void interpsectors(void)
 {
     int i;
-    float t;
 
-    if(!oldgs.sectorinfos || !newgs.sectorinfos)
+    const sectorinfo_t *old, *new;
+
+    if(!interpfrom || !interpfrom->gs.sectorinfos)
         return;
 
-    t = (abstime - lastrecvtime) * TICRATE;
-    t = CLAMP(t, 0, 1);
+    old = interpfrom->gs.sectorinfos;
+    new = interpto && interpto->gs.sectorinfos ? interpto->gs.sectorinfos : old;
 
     for(i=0; i<nsectors; i++)
     {
-        sectors[i].floorheight = LERP(oldgs.sectorinfos[i].floorheight, newgs.sectorinfos[i].floorheight, t);
-        sectors[i].ceilheight = LERP(oldgs.sectorinfos[i].ceilheight, newgs.sectorinfos[i].ceilheight, t);
+        sectors[i].moving = interpto
+        && (old[i].floorheight != new[i].floorheight || old[i].ceilheight != new[i].ceilheight);
+        sectors[i].floorheight = LERP(old[i].floorheight, new[i].floorheight, interpto ? interpfrac : 0);
+        sectors[i].ceilheight = LERP(old[i].ceilheight, new[i].ceilheight, interpto ? interpfrac : 0);
     }
 }
 
-void interpentities(float abstime)
+// once per pair of snapshots: entities that hold still between them are set to the newer one
+// and the rest are listed for interpent
+static void interpapply(void)
 {
     int i;
 
-    float interptime;
+    int maxmobj;
+    bool moved;
+    const objinfo_t *old, *new;
+    objinfo_t *obj;
 
-    interptime = (abstime - lastrecvtime) * TICRATE;
-    interptime = CLAMP(interptime, 0, 1);
+    // anything past the snapshots' maxmobj is gone
+    maxmobj = MAX(newgs.maxmobj, interpfrom->gs.maxmobj);
+    if(interpto)
+        maxmobj = MAX(maxmobj, interpto->gs.maxmobj);
 
-    for(i=0; i<=newgs.maxmobj; i++)
+    nmoving = 0;
+    for(i=0; i<=maxmobj; i++)
     {
         if(i == serverconn.edict)
             continue;
 
-        if(!newgs.mobjs[i].exists)
+        obj = &mobjs[i].info;
+        old = &interpfrom->gs.mobjs[i];
+        new = interpto ? &interpto->gs.mobjs[i] : old;
+
+        if(!new->exists)
         {
             level_unplacemobj(&mobjs[i]);
-            memset(&mobjs[i].info, 0, sizeof(objinfo_t));
+            memset(obj, 0, sizeof(objinfo_t));
             continue;
         }
 
-        if(!oldgs.mobjs[i].exists)
+        if(old->exists && (interpto ? old->x != new->x || old->y != new->y || old->z != new->z : old->xvel || old->yvel))
         {
-            level_unplacemobj(&mobjs[i]);
-            mobjs[i].info = newgs.mobjs[i];
-            level_placemobj(&mobjs[i]);
+            moving[nmoving++] = i;
             continue;
         }
 
-        interpent(interptime, i);
+        moved = !obj->exists || obj->x != new->x || obj->y != new->y;
+        *obj = *new;
+        if(moved)
+            level_relinkmobj(&mobjs[i]);
     }
 }
+
+void interpentities(void)
+{
+    int i;
+
+    if(!interpfrom)
+        return;
+
+    if(interpfrom->seq != appliedfrom || (interpto ? interpto->seq : 0) != appliedto)
+    {
+        interpapply();
+        appliedfrom = interpfrom->seq;
+        appliedto = interpto ? interpto->seq : 0;
+    }
+
+    for(i=0; i<nmoving; i++)
+        interpent(moving[i]);
+}
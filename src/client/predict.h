@@ -9,13 +9,34 @@
 
 #define PRED_WINDOW 256
 
+// bounds on the buffer kept on top of how long snapshots take to arrive
+#define INTERP_MINDELAY (1.0 / TICRATE)
+#define INTERP_MAXDELAY 0.25
+// entities keep going on their velocity this long when snapshots stop coming
+#define INTERP_MAXEXTRAP 0.1
+// the playout clock runs up to this much fast or slow to catch up to where it should be
+#define INTERP_SLEW 0.05
+// and jumps when it's further off than this
+#define INTERP_MAXDRIFT 0.25
+
 extern playercmd_t inputwindow[PRED_WINDOW];
-extern gamestate_t oldgs;
+// times the server didn't end up where we predicted, and commands simulated again because of it
+extern int predict_misses;
+extern int predict_resims;
 extern gamestate_t newgs;
 extern wpnst_t startwpn;
 
+// forgets the predicted states, for when the player or the level changes
+void predict_reset(void);
 void predictplayer(void);
-void interpsectors(float abstime);
-void interpentities(float abstime);
+// snaptime is the snapshot's server time, arrival when it got here
+void interp_addsnapshot(double snaptime, double arrival);
+void interp_reset(void);
+// moves the playout clock to abstime, call once a frame before interpolating
+void interp_update(double abstime);
+// the server time entities are being shown at, in ms
+int32_t interp_viewms(void);
+void interpsectors(void);
+void interpentities(void);
 
 #endif
\ No newline at end of file
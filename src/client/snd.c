@@ -16,7 +16,6 @@
 
 #define SND_CHANNELS   16
 #define SND_FREQ       44100
-#define SND_CLIPDIST   1200.0f
 #define SND_CLOSEDIST  160.0f
 
 typedef struct
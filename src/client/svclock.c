@@ -0,0 +1,83 @@
+#include "svclock.h"
+
+#include <math.h>
+
+#include "doommath.h"
+#include "level.h"
+
+typedef struct
+{
+    double offset; // server time less ours, halfway through the round trip
+    double time;
+    float rtt;
+} clocksample_t;
+
+bool svclock_synced = false;
+
+static clocksample_t samples[SVCLOCK_SAMPLES];
+static int nsamples = 0;
+
+// the estimate is offset at synctime, going up by drift each second after
+static double offset, synctime;
+static double drift;
+// drift is measured from the best sample at least SVCLOCK_DRIFTSECS back
+static clocksample_t driftbase;
+
+void svclock_reset(void)
+{
+    svclock_synced = false;
+    nsamples = 0;
+    drift = 0;
+}
+
+static double svclock_offset(double now)
+{
+    return offset + drift * (now - synctime);
+}
+
+void svclock_sample(int32_t tic, double sendtime, double now)
+{
+    int i;
+
+    clocksample_t *sample, *best;
+    double error, rate;
+
+    sample = &samples[nsamples++ % SVCLOCK_SAMPLES];
+    sample->rtt = now - sendtime;
+    sample->time = now;
+    sample->offset = (double) tic / TICRATE - (sendtime + now) / 2;
+
+    // queueing only ever makes a round trip longer, and the offset less sure.
+    // the quickest recent one is the one to go by
+    best = &samples[0];
+    for(i=1; i<MIN(nsamples, SVCLOCK_SAMPLES); i++)
+        if(samples[i].rtt < best->rtt)
+            best = &samples[i];
+
+    error = svclock_synced ? best->offset - svclock_offset(best->time) : INFINITY;
+    if(fabs(error) > SVCLOCK_MAXERROR)
+    {
+        offset = best->offset;
+        synctime = best->time;
+        drift = 0;
+        driftbase = *best;
+        svclock_synced = true;
+        return;
+    }
+
+    if(best->time - driftbase.time >= SVCLOCK_DRIFTSECS)
+    {
+        rate = (best->offset - driftbase.offset) / (best->time - driftbase.time);
+        drift += (CLAMP(rate, -SVCLOCK_MAXDRIFT, SVCLOCK_MAXDRIFT) - drift) / 2;
+        driftbase = *best;
+    }
+
+    // pulled part of the way over each time, so one odd sample doesn't jerk the timeline
+    offset = svclock_offset(now) + error / 8;
+    synctime = now;
+}
+
+double svclock_time(double now)
+{
+    return now + svclock_offset(now);
+}
@@ -0,0 +1,27 @@
+#ifndef _SVCLOCK_H
+#define _SVCLOCK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// round trips are sampled this many at a time, the quickest of them is trusted most
+#define SVCLOCK_SAMPLES 16
+// an estimate further off than this is thrown away instead of slewed
+#define SVCLOCK_MAXERROR 0.25
+// the most the server clock is believed to run fast or slow of ours
+#define SVCLOCK_MAXDRIFT 0.001
+// drift is measured over at least this long
+#define SVCLOCK_DRIFTSECS 10.0
+
+// the server's timeline in seconds, tic / TICRATE, estimated NTP style:
+// a snapshot built on tic went out about halfway between when we sent the packet
+// it acks and when it got back to us. interpolation and lag compensation both run on it
+extern bool svclock_synced;
+
+void svclock_reset(void);
+// sendtime and now are net_time()
+void svclock_sample(int32_t tic, double sendtime, double now);
+// server time at local time now
+double svclock_time(double now);
+
+#endif
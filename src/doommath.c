@@ -40,6 +40,65 @@ fixed_t fixeddiv(fixed_t a, fixed_t b)
 	return ((int64_t) a << FIXEDSHIFT) / b;
 }
 
+// the angle is folded into the first octant and the taylor series summed in 2.30 fixed point
+fixed_t fixedsin(angle_t ang)
+{
+    int i;
+    bool neg, usecos;
+    int64_t x, x2, term, sum;
+
+    neg = ang >= ANG180;
+    ang &= ANG180 - 1;
+    if(ang > ANG90)
+        ang = ANG180 - ang;
+    usecos = ang > ANG45;
+    if(usecos)
+        ang = ANG90 - ang;
+
+    // radians, pi in 2.30 is 3373259426
+    x = ((int64_t) ang * 3373259426LL) >> 31;
+    x2 = (x * x) >> 30;
+
+    term = sum = usecos ? 1 << 30 : x;
+    for(i=1; i<=5; i++)
+    {
+        if(usecos)
+            term = ((term * x2) >> 30) / ((2 * i - 1) * (2 * i));
+        else
+            term = ((term * x2) >> 30) / ((2 * i) * (2 * i + 1));
+        sum += (i & 1) ? -term : term;
+    }
+
+    sum = (sum + (1 << 13)) >> 14;
+    return neg ? -sum : sum;
+}
+
+fixed_t fixedexp2(fixed_t x)
+{
+    int i, n;
+    int64_t y, term, sum;
+
+    n = x >> FIXEDSHIFT;
+    
+    // e^(frac * ln 2), ln 2 in 2.30 is 744261118
+    y = ((int64_t) (x & (FIXEDUNIT - 1)) * 744261118LL) >> FIXEDSHIFT;
+    term = sum = 1 << 30;
+    for(i=1; i<=8; i++)
+    {
+        term = ((term * y) >> 30) / i;
+        sum += term;
+    }
+
+    n -= 30 - FIXEDSHIFT;
+    if(n <= -63)
+        return 0;
+    if(n < 0)
+        return sum >> -n;
+    if(n >= 31 || (sum << n) > INT_MAX)
+        return INT_MAX;
+    return sum << n;
+}
+
 float segmentsegment(float v1x1, float v1y1, float v1x2, float v1y2, float v2x1, float v2y1, float v2x2, float v2y2)
 {
     float dx1, dy1, dx2, dy2;
@@ -26,8 +26,14 @@
 #define RADTOANG(rad) ((angle_t) (sangle_t) ((double) (rad) / (2.0 * M_PI) * (double) BAM_SCALE))
 #define DEGTOANG(deg) ((angle_t) (sangle_t) ((double) (deg) / 360.0 * (double) BAM_SCALE))
 
+#ifdef FIXEDSIM
+// libm sin and cos differ between the native and wasm builds, so movement uses fixedsin
+#define ANGSIN(ang) FIXEDTOFLOAT(fixedsin(ang))
+#define ANGCOS(ang) FIXEDTOFLOAT(fixedsin((angle_t) (ang) + ANG90))
+#else
 #define ANGSIN(ang) sin(ANGTORAD(ang))
 #define ANGCOS(ang) cos(ANGTORAD(ang))
+#endif
 #define ANGTAN(ang) tan(ANGTORAD(ang))
 #define ANGATAN(val) RADTOANG(atan(val))
 #define ANGATAN2(y, x) RADTOANG(atan2(y, x))
@@ -52,6 +58,10 @@ float magnitude(float x, float y);
 fixed_t fixedmag(fixed_t x, fixed_t y);
 fixed_t fixedmul(fixed_t a, fixed_t b);
 fixed_t fixeddiv(fixed_t a, fixed_t b);
+// integer only, so every build gets the same bits
+fixed_t fixedsin(angle_t ang);
+// 2 to the power of x
+fixed_t fixedexp2(fixed_t x);
 
 // returns t along line 1 where it hits seg 2
 // t can be < 0 or > 1 but that means its not on the segment
@@ -1,6 +1,7 @@
 #include "level.h"
 
 #include <assert.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -122,90 +123,184 @@ int nnodes = 0;
 node_t *nodes = NULL;
 int nsegs = 0;
 seg_t *segs = NULL;
+uint8_t *rejectmatrix = NULL;
 int mobjmax;
 object_t mobjs[MAX_MOBJ] = {};
 blockmap_t blockmap = {};
 int numdmstarts = 0;
 startloc_t dmstarts[MAX_DMSTART];
 
-object_t *curmobj = NULL;
+_Thread_local object_t *curmobj = NULL;
+_Thread_local levelfxqueue_t *level_fxqueue = NULL;
 bool level_isclient = false;
 
+// sectors can span several regions, so parallel workers take this to relink
+static pthread_mutex_t sectorlock = PTHREAD_MUTEX_INITIALIZER;
+
 texture_t* levelskytex = NULL;
 const char *episodeskies[] =
 {
     "SKY1", "SKY2", "SKY3", "SKY1", "SKY3"
 };
 
-void level_unplacemobj(object_t* mobj)
+static secnode_t *freesecnodes = NULL;
+
+static void level_linktouching(object_t* mobj, sector_t* sector)
 {
-    object_t *cur;
+    secnode_t *node;
 
-    sector_t *sector;
-    block_t *blk;
-    object_t *prev, *next;
+    for(node=mobj->touching; node; node=node->mnext)
+        if(node->sector == sector)
+            return;
 
-    if(mobj->ssector)
+    if(freesecnodes)
     {
-        sector = mobj->ssector->sector;
-        for(cur=sector->mobjs; cur&&cur!=mobj; cur=cur->snext);
-        if(cur)
+        node = freesecnodes;
+        freesecnodes = node->mnext;
+    }
+    else
+        node = malloc(sizeof(secnode_t));
+
+    node->sector = sector;
+    node->mobj = mobj;
+
+    node->mnext = mobj->touching;
+    mobj->touching = node;
+
+    node->sprev = NULL;
+    node->snext = sector->touching;
+    if(node->snext)
+        node->snext->sprev = node;
+    sector->touching = node;
+}
+
+static void level_unlinktouching(object_t* mobj)
+{
+    secnode_t *node, *next;
+
+    for(node=mobj->touching; node; node=next)
+    {
+        next = node->mnext;
+
+        if(node->sprev)
+            node->sprev->snext = node->snext;
+        else
+            node->sector->touching = node->snext;
+        if(node->snext)
+            node->snext->sprev = node->sprev;
+
+        node->mnext = freesecnodes;
+        freesecnodes = node;
+    }
+
+    mobj->touching = NULL;
+}
+
+// hands every mobj's nodes back before a new level. the old sectors' lists go with the
+// sectors, so they're left alone. every node is in exactly one mobj's list
+static void level_freetouching(void)
+{
+    int i;
+
+    secnode_t *node, *next;
+
+    for(i=0; i<MAX_MOBJ; i++)
+    {
+        for(node=mobjs[i].touching; node; node=next)
         {
-            prev = cur->sprev;
-            next = cur->snext;
-
-            if(prev)
-                prev->snext = next;
-            else
-                sector->mobjs = next;
-            
-            if(next)
-                next->sprev = prev;
+            next = node->mnext;
+            node->mnext = freesecnodes;
+            freesecnodes = node;
         }
+        mobjs[i].touching = NULL;
+    }
+}
+
+static void level_touchingcol(linedef_t* line, void* ctx)
+{
+    if(line->front && line->front->sector)
+        level_linktouching(ctx, line->front->sector);
+    if(line->back && line->back->sector)
+        level_linktouching(ctx, line->back->sector);
+}
+
+static block_t* level_pointblock(float x, float y)
+{
+    int bx, by;
+
+    bx = floorf((x - blockmap.xorg) / BLOCK_SIZE);
+    by = floorf((y - blockmap.yorg) / BLOCK_SIZE);
+    if(bx < 0 || bx >= blockmap.w || by < 0 || by >= blockmap.h)
+        return NULL;
+
+    return &blockmap.blks[by * blockmap.w + bx];
+}
+
+// a placed mobj is always in its sector's and block's lists, so it unlinks through its own pointers
+void level_unplacemobj(object_t* mobj)
+{
+    pthread_mutex_lock(&sectorlock);
+
+    if(mobj->ssector)
+    {
+        if(mobj->sprev)
+            mobj->sprev->snext = mobj->snext;
+        else
+            mobj->ssector->sector->mobjs = mobj->snext;
+
+        if(mobj->snext)
+            mobj->snext->sprev = mobj->sprev;
+
+        mobj->sprev = mobj->snext = NULL;
         mobj->ssector = NULL;
     }
 
+    level_unlinktouching(mobj);
+
+    pthread_mutex_unlock(&sectorlock);
+
     if(mobj->blk)
     {
-        blk = mobj->blk;
-        for(cur=blk->mobjs; cur&&cur!=mobj; cur=cur->bnext);
-        if(cur)
-        {
-            prev = cur->bprev;
-            next = cur->bnext;
+        if(mobj->bprev)
+            mobj->bprev->bnext = mobj->bnext;
+        else
+            mobj->blk->mobjs = mobj->bnext;
 
-            if(prev)
-                prev->bnext = next;
-            else
-                blk->mobjs = next;
+        if(mobj->bnext)
+            mobj->bnext->bprev = mobj->bprev;
 
-            if(next)
-                next->bprev = prev;
-        }
+        mobj->bprev = mobj->bnext = NULL;
         mobj->blk = NULL;
     }
 }
 
 void level_placemobj(object_t* mobj)
 {
-    int bx, by;
-
     mobj->ssector = level_getpointssector(mobj->info.x, mobj->info.y);
     mobj->sprev = mobj->snext = NULL;
 
+    pthread_mutex_lock(&sectorlock);
+
     if(mobj->ssector)
     {
         mobj->snext = mobj->ssector->sector->mobjs;
         mobj->ssector->sector->mobjs = mobj;
         if(mobj->snext)
             mobj->snext->sprev = mobj;
+
+        // only sector movers read the touching lists, and they only run on the server
+        if(!level_isclient)
+        {
+            level_linktouching(mobj, mobj->ssector->sector);
+            level_thingcollisions(mobj->info.x, mobj->info.y, mobjinfo[mobj->info.type].radius, level_touchingcol, NULL, mobj);
+        }
     }
 
-    bx = floorf((mobj->info.x - blockmap.xorg) / BLOCK_SIZE);
-    by = floorf((mobj->info.y - blockmap.yorg) / BLOCK_SIZE);
-    if(bx >= 0 && bx < blockmap.w && by >= 0 && by < blockmap.h)
+    pthread_mutex_unlock(&sectorlock);
+
+    mobj->blk = level_pointblock(mobj->info.x, mobj->info.y);
+    if(mobj->blk)
     {
-        mobj->blk = &blockmap.blks[by * blockmap.w + bx];
         mobj->bprev = NULL;
         mobj->bnext = mobj->blk->mobjs;
         if(mobj->blk->mobjs)
@@ -214,6 +309,18 @@ void level_placemobj(object_t* mobj)
     }
 }
 
+void level_relinkmobj(object_t* mobj)
+{
+    // the server's touching lists follow the whole bounding box, so it always relinks
+    if(level_isclient && mobj->ssector
+    && level_getpointssector(mobj->info.x, mobj->info.y) == mobj->ssector
+    && level_pointblock(mobj->info.x, mobj->info.y) == mobj->blk)
+        return;
+
+    level_unplacemobj(mobj);
+    level_placemobj(mobj);
+}
+
 int level_findnewedict(void)
 {
     int i;
@@ -400,7 +507,7 @@ bool level_checksquareobj(int bx, int by, float x, float y, float radius, object
     return false;
 }
 
-bool level_traverseline(float x1, float y1, float x2, float y2, bool noearlyexit, linelinecol_t linecol, linemobjcol_t mobjcol)
+bool level_traverseline(float x1, float y1, float x2, float y2, bool noearlyexit, linelinecol_t linecol, linemobjcol_t mobjcol, void* ctx)
 {
     int i;
     object_t *mobj;
@@ -487,9 +594,9 @@ bool level_traverseline(float x1, float y1, float x2, float y2, bool noearlyexit
                     break;
                 prevt = bestt;
 
-                if(bestline && linecol && linecol(x1, y1, x2, y2, bestline, bestt) && !noearlyexit)
+                if(bestline && linecol && linecol(x1, y1, x2, y2, bestline, bestt, ctx) && !noearlyexit)
                     return true;
-                if(bestmobj && mobjcol && mobjcol(x1, y1, x2, y2, bestmobj, bestt) && !noearlyexit)
+                if(bestmobj && mobjcol && mobjcol(x1, y1, x2, y2, bestmobj, bestt, ctx) && !noearlyexit)
                     return true;
             }
         }
@@ -519,7 +626,7 @@ bool level_traverseline(float x1, float y1, float x2, float y2, bool noearlyexit
     return false;
 }
 
-bool level_thingcollisions(float x, float y, float radius, mobjlinecol_t linecol, mobjmobjcol_t mobjcol)
+bool level_thingcollisions(float x, float y, float radius, mobjlinecol_t linecol, mobjmobjcol_t mobjcol, void* ctx)
 {
     int bx, by;
     int l;
@@ -553,7 +660,7 @@ bool level_thingcollisions(float x, float y, float radius, mobjlinecol_t linecol
                 for(l=0; l<blk->nlines; l++)
                 {
                     if(level_linesquare(blk->lines[l], radius, x, y))
-                        linecol(blk->lines[l]);
+                        linecol(blk->lines[l], ctx);
                 }
             }
 
@@ -567,33 +674,268 @@ bool level_thingcollisions(float x, float y, float radius, mobjlinecol_t linecol
                     my = mobj->info.y;
                     mr = mobjinfo[mobj->info.type].radius;
                     if(boxbox(x-radius, y-radius, x+radius, y+radius, mx-mr, my-mr, mx+mr, my+mr))
-                        mobjcol(mobj);
+                        mobjcol(mobj, ctx);
+                }
+            }
+        }
+    }
+}
+
+// entry and exit times of a moving interval [bmin, bmax] (velocity v) against a static one [smin, smax].
+// returns false if they never overlap
+static bool level_sweepaxis(float bmin, float bmax, float smin, float smax, float v, float* enter, float* leave)
+{
+    if(v == 0)
+    {
+        if(bmax <= smin || bmin >= smax)
+            return false;
+        *enter = -INFINITY;
+        *leave = INFINITY;
+        return true;
+    }
+
+    if(v > 0)
+    {
+        *enter = (smin - bmax) / v;
+        *leave = (smax - bmin) / v;
+    }
+    else
+    {
+        *enter = (smax - bmin) / v;
+        *leave = (smin - bmax) / v;
+    }
+
+    return true;
+}
+
+// separating axis sweep of a box against a line: the axes are x, y and the line normal
+static bool level_sweepline(float x, float y, float radius, float dx, float dy, linedef_t* line, float* t, float* nx, float* ny)
+{
+    float lx1, ly1, lx2, ly2;
+    float lnx, lny, len, c, s, e, v;
+    float enter, leave, axenter, axleave;
+    float hitnx, hitny;
+
+    lx1 = line->v1->x;
+    ly1 = line->v1->y;
+    lx2 = line->v2->x;
+    ly2 = line->v2->y;
+
+    lnx = ly1 - ly2;
+    lny = lx2 - lx1;
+    len = magnitude(lnx, lny);
+    if(len == 0)
+        return false;
+    lnx /= len;
+    lny /= len;
+
+    if(!level_sweepaxis(x - radius, x + radius, MIN(lx1, lx2), MAX(lx1, lx2), dx, &enter, &leave))
+        return false;
+    hitnx = dx > 0 ? -1 : 1;
+    hitny = 0;
+
+    if(!level_sweepaxis(y - radius, y + radius, MIN(ly1, ly2), MAX(ly1, ly2), dy, &axenter, &axleave))
+        return false;
+    if(axenter > enter)
+    {
+        enter = axenter;
+        hitnx = 0;
+        hitny = dy > 0 ? -1 : 1;
+    }
+    leave = MIN(leave, axleave);
+
+    c = x * lnx + y * lny;
+    s = lx1 * lnx + ly1 * lny;
+    e = radius * (fabsf(lnx) + fabsf(lny));
+    v = dx * lnx + dy * lny;
+    if(!level_sweepaxis(c - e, c + e, s, s, v, &axenter, &axleave))
+        return false;
+    if(axenter > enter)
+    {
+        enter = axenter;
+        hitnx = v > 0 ? -lnx : lnx;
+        hitny = v > 0 ? -lny : lny;
+    }
+    leave = MIN(leave, axleave);
+
+    if(enter >= leave || enter > 1 || leave <= 0)
+        return false;
+
+    if(enter < 0)
+    {
+        // already touching, only block if moving further into the line
+        if((c - s) * v >= 0)
+            return false;
+        enter = 0;
+        hitnx = c - s > 0 ? lnx : -lnx;
+        hitny = c - s > 0 ? lny : -lny;
+    }
+
+    *t = enter;
+    *nx = hitnx;
+    *ny = hitny;
+    return true;
+}
+
+static bool level_sweepmobj(float x, float y, float radius, float dx, float dy, object_t* mobj, float* t, float* nx, float* ny)
+{
+    float mr;
+    float enter, leave, axenter, axleave;
+    float hitnx, hitny;
+
+    mr = mobjinfo[mobj->info.type].radius;
+
+    if(!level_sweepaxis(x - radius, x + radius, mobj->info.x - mr, mobj->info.x + mr, dx, &enter, &leave))
+        return false;
+    hitnx = dx > 0 ? -1 : 1;
+    hitny = 0;
+
+    if(!level_sweepaxis(y - radius, y + radius, mobj->info.y - mr, mobj->info.y + mr, dy, &axenter, &axleave))
+        return false;
+    if(axenter > enter)
+    {
+        enter = axenter;
+        hitnx = 0;
+        hitny = dy > 0 ? -1 : 1;
+    }
+    leave = MIN(leave, axleave);
+
+    if(enter >= leave || enter > 1 || leave <= 0)
+        return false;
+
+    if(enter < 0)
+    {
+        // overlapping already, let it walk out but not further in
+        if((x - mobj->info.x) * dx + (y - mobj->info.y) * dy >= 0)
+            return false;
+        enter = 0;
+        if(fabsf(x - mobj->info.x) > fabsf(y - mobj->info.y))
+        {
+            hitnx = x > mobj->info.x ? 1 : -1;
+            hitny = 0;
+        }
+        else
+        {
+            hitnx = 0;
+            hitny = y > mobj->info.y ? 1 : -1;
+        }
+    }
+
+    *t = enter;
+    *nx = hitnx;
+    *ny = hitny;
+    return true;
+}
+
+bool level_sweepbox(float x, float y, float radius, float dx, float dy, sweeplinecol_t linecol, sweepmobjcol_t mobjcol, void* ctx, sweephit_t* hit)
+{
+    int bx, by;
+    int l;
+    object_t *mobj;
+
+    int bminx, bminy, bmaxx, bmaxy;
+    block_t *blk;
+    linedef_t *line;
+    float t, nx, ny;
+
+    hit->t = INFINITY;
+    hit->line = NULL;
+    hit->mobj = NULL;
+
+    // mobjs are linked by their center, so pad the swept bounds like thingcollisions does
+    bminx = floorf((MIN(x, x + dx) - radius - 32 - blockmap.xorg) / BLOCK_SIZE);
+    bminy = floorf((MIN(y, y + dy) - radius - 32 - blockmap.yorg) / BLOCK_SIZE);
+    bmaxx = floorf((MAX(x, x + dx) + radius + 32 - blockmap.xorg) / BLOCK_SIZE);
+    bmaxy = floorf((MAX(y, y + dy) + radius + 32 - blockmap.yorg) / BLOCK_SIZE);
+
+    bminx = MAX(bminx, 0);
+    bminy = MAX(bminy, 0);
+    bmaxx = MIN(bmaxx, blockmap.w - 1);
+    bmaxy = MIN(bmaxy, blockmap.h - 1);
+
+    for(by=bminy; by<=bmaxy; by++)
+    {
+        for(bx=bminx; bx<=bmaxx; bx++)
+        {
+            blk = &blockmap.blks[by * blockmap.w + bx];
+
+            if(linecol)
+            {
+                for(l=0; l<blk->nlines; l++)
+                {
+                    line = blk->lines[l];
+                    if(!level_sweepline(x, y, radius, dx, dy, line, &t, &nx, &ny))
+                        continue;
+                    if(t >= hit->t || !linecol(line, ctx))
+                        continue;
+
+                    hit->t = t;
+                    hit->nx = nx;
+                    hit->ny = ny;
+                    hit->line = line;
+                    hit->mobj = NULL;
+                }
+            }
+
+            if(mobjcol)
+            {
+                for(mobj=blk->mobjs; mobj; mobj=mobj->bnext)
+                {
+                    if(!level_sweepmobj(x, y, radius, dx, dy, mobj, &t, &nx, &ny))
+                        continue;
+                    if(t >= hit->t || !mobjcol(mobj, ctx))
+                        continue;
+
+                    hit->t = t;
+                    hit->nx = nx;
+                    hit->ny = ny;
+                    hit->line = NULL;
+                    hit->mobj = mobj;
                 }
             }
         }
     }
+
+    return hit->t != INFINITY;
 }
 
-float mobjfloorheight, mobjceilheight;
+typedef struct
+{
+    float floor, ceil;
+} heightsctx_t;
 
-static void level_mobjheightscol(linedef_t* line)
+static void level_mobjheightscol(linedef_t* line, void* ctx)
 {
+    heightsctx_t *heights;
+
+    heights = ctx;
+
     if(!line->back && !line->front)
         return;
 
-    mobjfloorheight = MAX(mobjfloorheight, level_linelower(line));
-    mobjceilheight = MIN(mobjceilheight, level_lineupper(line));
+    heights->floor = MAX(heights->floor, level_linelower(line));
+    heights->ceil = MIN(heights->ceil, level_lineupper(line));
 }
 
-void level_mobjheights(object_t* mobj)
+void level_mobjheights(object_t* mobj, float* floor, float* ceil)
 {
-    if(!mobj->ssector)
-        mobj->ssector = level_getpointssector(mobj->info.x, mobj->info.y);
+    heightsctx_t heights;
+    ssector_t *ssector;
 
-    mobjfloorheight = mobj->ssector->sector->floorheight;
-    mobjceilheight = mobj->ssector->sector->ceilheight;
+    // an unplaced mobj mustn't get an ssector, that would say it's in the sector's list
+    ssector = mobj->ssector;
+    if(!ssector)
+        ssector = level_getpointssector(mobj->info.x, mobj->info.y);
 
-    level_thingcollisions(mobj->info.x, mobj->info.y, mobjinfo[mobj->info.type].radius, level_mobjheightscol, NULL);
+    heights.floor = ssector->sector->floorheight;
+    heights.ceil = ssector->sector->ceilheight;
+
+    level_thingcollisions(mobj->info.x, mobj->info.y, mobjinfo[mobj->info.type].radius, level_mobjheightscol, NULL, &heights);
+
+    if(floor)
+        *floor = heights.floor;
+    if(ceil)
+        *ceil = heights.ceil;
 }
 
 int level_nodeside(node_t* node, float x, float y)
@@ -711,36 +1053,45 @@ float level_lineupper(linedef_t* line)
     return upper;
 }
 
-bool level_mobjstuckinblock(int bx, int by)
+bool level_mobjstuckinsector(sector_t* sector)
 {
+    secnode_t *node;
     object_t *obj;
+    float floor, ceil;
 
-    block_t *blk;
-
-    if(bx < 0 || by < 0 || bx >= blockmap.w || by >= blockmap.h)
-        return false;
-
-    blk = &blockmap.blks[by * blockmap.w + bx];
-    for(obj=blk->mobjs; obj; obj=obj->bnext)
+    for(node=sector->touching; node; node=node->snext)
     {
-        level_mobjheights(obj);
-        if(mobjceilheight - mobjfloorheight < mobjinfo[obj->info.type].height)
+        obj = node->mobj;
+        level_mobjheights(obj, &floor, &ceil);
+        if(ceil - floor < mobjinfo[obj->info.type].height)
             return true;
     }
 
     return false;
 }
 
-bool level_mobjstuckinsector(sector_t* sector)
+static bool level_sectormoving(sector_t* sector)
 {
-    int bx, by;
+    return sector && (sector->thinker || sector->moving);
+}
 
-    for(bx=sector->bminx; bx<=sector->bmaxx; bx++)
-        for(by=sector->bminy; by<=sector->bmaxy; by++)
-            if(level_mobjstuckinblock(bx, by))
-                return true;
+static void level_onmovercol(linedef_t* line, void* ctx)
+{
+    if((line->front && level_sectormoving(line->front->sector))
+    || (line->back && level_sectormoving(line->back->sector)))
+        *(bool*) ctx = true;
+}
 
-    return false;
+bool level_mobjonmover(object_t* mobj)
+{
+    bool onmover;
+
+    if(mobj->ssector && level_sectormoving(mobj->ssector->sector))
+        return true;
+
+    onmover = false;
+    level_thingcollisions(mobj->info.x, mobj->info.y, mobjinfo[mobj->info.type].radius, level_onmovercol, NULL, &onmover);
+    return onmover;
 }
 
 typedef struct
@@ -754,6 +1105,8 @@ void level_setmobjstate(object_t* obj, statenum_t state)
 {
     object_t *oldcur;
 
+    level_wakemobj(obj);
+
     oldcur = curmobj;
     curmobj = obj;
     obj->info.state = state;
@@ -807,9 +1160,17 @@ void level_damagemobj(object_t* obj, int dmg, object_t* inflictor, object_t* src
     angle_t a;
     float knockback;
 
+    if(level_fxqueue)
+    {
+        level_queuefx(level_fxqueue, LEVELFX_DAMAGE, obj, dmg, inflictor, src);
+        return;
+    }
+
     if(obj->info.health <= 0)
         return;
 
+    level_wakemobj(obj);
+
     if(obj->player)
         level_damageplayer(obj, dmg, inflictor, src);
     else
@@ -858,6 +1219,59 @@ void level_damagemobj(object_t* obj, int dmg, object_t* inflictor, object_t* src
     }
 }
 
+// nothing for the thinker to do until something changes the mobj from outside
+static bool level_mobjidle(object_t* mobj)
+{
+    // the client never advances or moves mobjs itself
+    if(level_isclient)
+        return true;
+
+    // players are moved by their commands, not their mobj thinker
+    if(mobj->player)
+        return false;
+
+    if(states[mobj->info.state].tics != -1)
+        return false;
+
+    return !mobj->info.xvel && !mobj->info.yvel && !mobj->info.zvel;
+}
+
+static void level_sleepmobj(object_t* obj)
+{
+    if(!obj->thinker)
+        return;
+
+    if(level_fxqueue)
+    {
+        level_queuefx(level_fxqueue, LEVELFX_SLEEP, obj, 0, NULL, NULL);
+        return;
+    }
+
+    sleepthinker(obj->thinker);
+}
+
+void level_wakemobj(object_t* obj)
+{
+    if(!obj->thinker || !obj->thinker->asleep)
+        return;
+
+    if(level_fxqueue)
+    {
+        level_queuefx(level_fxqueue, LEVELFX_WAKE, obj, 0, NULL, NULL);
+        return;
+    }
+
+    wakethinker(obj->thinker);
+}
+
+void level_wakesector(sector_t* sector)
+{
+    secnode_t *node;
+
+    for(node=sector->touching; node; node=node->snext)
+        level_wakemobj(node->mobj);
+}
+
 bool level_mobjthink(mobjthink_t* thinker, float ft, float progtime)
 {
     curmobj = thinker->mobj;
@@ -886,6 +1300,11 @@ bool level_mobjthink(mobjthink_t* thinker, float ft, float progtime)
             move(curmobj, ft);
     }
 
+    if(level_mobjidle(thinker->mobj))
+        level_sleepmobj(thinker->mobj);
+
+    // never kills the thinker itself, level_removemobj frees it instead.
+    // parallel think relies on this
     return false;
 }
 
@@ -907,6 +1326,70 @@ void level_addmobjthinker(object_t* obj)
     addthinker(obj->thinker);
 }
 
+object_t* level_thinkermobj(thinker_t* thinker)
+{
+    if(thinker->func != (thinkfunc_t) level_mobjthink)
+        return NULL;
+
+    return ((mobjthink_t*) thinker)->mobj;
+}
+
+void level_queuefx(levelfxqueue_t* queue, levelfx_e type, object_t* obj, int amount, object_t* inflictor, object_t* src)
+{
+    levelfx_t *fx;
+
+    if(queue->nfx >= queue->maxfx)
+    {
+        queue->maxfx = queue->maxfx ? queue->maxfx * 2 : 16;
+        queue->fx = realloc(queue->fx, queue->maxfx * sizeof(levelfx_t));
+    }
+
+    fx = &queue->fx[queue->nfx++];
+    fx->type = type;
+    fx->obj = obj;
+    fx->amount = amount;
+    fx->inflictor = inflictor;
+    fx->src = src;
+}
+
+void level_applyfx(levelfxqueue_t* queue)
+{
+    int i;
+    levelfx_t *fx;
+
+    for(i=0, fx=queue->fx; i<queue->nfx; i++, fx++)
+    {
+        // an earlier effect may have removed it
+        if(!fx->obj->info.exists)
+            continue;
+
+        switch(fx->type)
+        {
+        case LEVELFX_DAMAGE:
+            level_damagemobj(fx->obj, fx->amount, fx->inflictor, fx->src);
+            break;
+        case LEVELFX_REMOVE:
+            level_removemobj(fx->obj);
+            break;
+        case LEVELFX_SOUND:
+            snd_queueedict(fx->amount, fx->obj - mobjs);
+            break;
+        case LEVELFX_SLEEP:
+            // something later in the merge may have disturbed it
+            if(level_mobjidle(fx->obj))
+                level_sleepmobj(fx->obj);
+            break;
+        case LEVELFX_WAKE:
+            level_wakemobj(fx->obj);
+            break;
+        default:
+            break;
+        }
+    }
+
+    queue->nfx = 0;
+}
+
 void level_trigger(object_t* user, int sectag, int special)
 {
     int i;
@@ -940,6 +1423,12 @@ void level_trigger(object_t* user, int sectag, int special)
 // TODO: respawning because deathmatch
 void level_removemobj(object_t* obj)
 {
+    if(level_fxqueue)
+    {
+        level_queuefx(level_fxqueue, LEVELFX_REMOVE, obj, 0, NULL, NULL);
+        return;
+    }
+
     level_unplacemobj(obj);
     if(obj->thinker)
         freethinker(obj->thinker);
@@ -963,6 +1452,15 @@ void level_loadthings(lumpinfo_t* header)
 
     mapthings = lump->cache;
 
+    // whatever is left from the last level is linked into its sectors and blocks
+    for(i=0; i<MAX_MOBJ; i++)
+    {
+        mobjs[i].ssector = NULL;
+        mobjs[i].blk = NULL;
+        mobjs[i].snext = mobjs[i].sprev = NULL;
+        mobjs[i].bnext = mobjs[i].bprev = NULL;
+    }
+
     mobjmax = -1;
     for(i=0; i<nthings; i++)
     {
@@ -1140,9 +1638,11 @@ void level_loadsectors(lumpinfo_t* header)
         sectors[i].tag = mapsectors[i].tag;
         sectors[i].frameindex = -1;
         sectors[i].mobjs = NULL;
+        sectors[i].touching = NULL;
         sectors[i].nlines = 0;
         sectors[i].lines = NULL;
         sectors[i].thinker = NULL;
+        sectors[i].moving = false;
         sectors[i].bminx = sectors[i].bmaxx = sectors[i].bminy = sectors[i].bmaxy = -1;
     }
 
@@ -1306,6 +1806,36 @@ void level_loadsegs(lumpinfo_t* header)
     wad_decache(lump);
 }
 
+void level_loadreject(lumpinfo_t* header)
+{
+    lumpinfo_t *lump;
+
+    lump = header + LUMPOFFS_REJECT;
+
+    free(rejectmatrix);
+    rejectmatrix = NULL;
+
+    // some nodebuilders leave it empty or short
+    if(lump->size < (nsectors * nsectors + 7) / 8)
+        return;
+
+    wad_cache(lump);
+    rejectmatrix = malloc(lump->size);
+    memcpy(rejectmatrix, lump->cache, lump->size);
+    wad_decache(lump);
+}
+
+bool level_rejected(sector_t* from, sector_t* to)
+{
+    int bit;
+
+    if(!rejectmatrix)
+        return false;
+
+    bit = (from - sectors) * nsectors + (to - sectors);
+    return rejectmatrix[bit >> 3] & (1 << (bit & 7));
+}
+
 void level_loadblockmap(lumpinfo_t* header)
 {
     int i, j;
@@ -1367,6 +1897,7 @@ void level_load(int e, int m)
         return;
     }
 
+    level_freetouching();
     level_loadverts(lump);
     level_loadsectors(lump);
     level_loadsidedefs(lump);
@@ -1374,6 +1905,7 @@ void level_load(int e, int m)
     level_loadssectors(lump);
     level_loadnodes(lump);
     level_loadsegs(lump);
+    level_loadreject(lump);
     level_loadblockmap(lump);
 
     level_linksectors();
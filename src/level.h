@@ -37,6 +37,7 @@ typedef struct ssector_s ssector_t;
 typedef struct sidedef_s sidedef_t;
 typedef struct vertex_s vertex_t;
 typedef struct block_s block_t;
+typedef struct secnode_s secnode_t;
 
 typedef enum
 {
@@ -88,6 +89,8 @@ struct object_s
 
     object_t *snext, *sprev; // sector list
     object_t *bnext, *bprev; // block list
+
+    secnode_t *touching; // every sector the bounding box overlaps
 };
 
 typedef struct
@@ -156,13 +159,27 @@ struct sector_s
 
     int frameindex;
     object_t *mobjs;
+    secnode_t *touching; // every mobj whose bounding box overlaps this sector
 
     struct thinker_s *thinker;
+    // the client has no movers, it sets this when the snapshots have the sector moving
+    bool moving;
 
     // blockmap bounds
     int bminx, bmaxx, bminy, bmaxy;
 };
 
+// links one mobj to one sector it overlaps.
+// threaded through both the mobj's and the sector's touching lists
+struct secnode_s
+{
+    sector_t *sector;
+    object_t *mobj;
+
+    secnode_t *mnext; // next sector touched by mobj
+    secnode_t *snext, *sprev; // sector's list of touching mobjs
+};
+
 struct block_s
 {
     int nlines;
@@ -201,6 +218,8 @@ extern int nnodes;
 extern node_t *nodes;
 extern int nsegs;
 extern seg_t *segs;
+// bit from * nsectors + to is set if nothing in from can see into to. NULL if the map has none
+extern uint8_t *rejectmatrix;
 extern blockmap_t blockmap;
 extern int mobjmax;
 extern object_t mobjs[MAX_MOBJ];
@@ -212,38 +231,96 @@ extern texture_t* levelskytex;
 
 extern float linerangebottom, linerangetop, linerange;
 
-extern float mobjfloorheight, mobjceilheight;
+// effects a worker can't apply while mobjs are simulated in parallel.
+// each region queues its own and they're applied in region order at the end of the tic
+typedef enum
+{
+    LEVELFX_DAMAGE=0,
+    LEVELFX_REMOVE,
+    LEVELFX_SOUND,
+    LEVELFX_SLEEP,
+    LEVELFX_WAKE,
+} levelfx_e;
+
+typedef struct
+{
+    levelfx_e type;
+    object_t *obj;
+    int amount; // damage or sfx id
+    object_t *inflictor, *src;
+} levelfx_t;
+
+typedef struct
+{
+    int nfx, maxfx;
+    levelfx_t *fx;
+} levelfxqueue_t;
 
-extern object_t *curmobj;
+extern _Thread_local object_t *curmobj;
+// set while this thread is simulating a region in parallel, NULL otherwise
+extern _Thread_local levelfxqueue_t *level_fxqueue;
 extern bool level_isclient;
 
+// every query callback gets the ctx pointer passed to the query, so callers
+// keep their state on the stack instead of in globals and queries can nest or run concurrently.
 // return true if actual collision
-typedef bool (*linelinecol_t)(float x1, float y1, float x2, float y2, linedef_t* line, float t);
-typedef bool (*linemobjcol_t)(float x1, float y1, float x2, float y2, object_t* mobj, float t);
-typedef void (*mobjlinecol_t)(linedef_t* line);
-typedef void (*mobjmobjcol_t)(object_t* obj);
+typedef bool (*linelinecol_t)(float x1, float y1, float x2, float y2, linedef_t* line, float t, void* ctx);
+typedef bool (*linemobjcol_t)(float x1, float y1, float x2, float y2, object_t* mobj, float t, void* ctx);
+typedef void (*mobjlinecol_t)(linedef_t* line, void* ctx);
+typedef void (*mobjmobjcol_t)(object_t* obj, void* ctx);
+// return true if the line/mobj should stop a swept box
+typedef bool (*sweeplinecol_t)(linedef_t* line, void* ctx);
+typedef bool (*sweepmobjcol_t)(object_t* obj, void* ctx);
+
+typedef struct
+{
+    float t; // fraction of the move completed at contact
+    float nx, ny; // unit slide normal, points away from what was hit
+    linedef_t *line;
+    object_t *mobj;
+} sweephit_t;
 
 void level_unplacemobj(object_t* mobj);
 void level_placemobj(object_t* mobj);
+// call after moving a placed mobj. only relinks if it changed subsector or block
+void level_relinkmobj(object_t* mobj);
 // finds an index to put a new mobj. -1 if edict full
 int level_findnewedict(void);
-bool level_traverseline(float x1, float y1, float x2, float y2, bool noearlyexit, linelinecol_t linecol, linemobjcol_t mobjcol);
-bool level_thingcollisions(float x, float y, float radius, mobjlinecol_t linecol, mobjmobjcol_t mobjcol);
-void level_mobjheights(object_t* mobj);
+bool level_traverseline(float x1, float y1, float x2, float y2, bool noearlyexit, linelinecol_t linecol, linemobjcol_t mobjcol, void* ctx);
+bool level_thingcollisions(float x, float y, float radius, mobjlinecol_t linecol, mobjmobjcol_t mobjcol, void* ctx);
+// moves a box of half-size radius by (dx, dy) against blockmap lines and mobjs.
+// returns true and fills hit with the earliest blocking contact, false if the whole move is clear.
+bool level_sweepbox(float x, float y, float radius, float dx, float dy, sweeplinecol_t linecol, sweepmobjcol_t mobjcol, void* ctx, sweephit_t* hit);
+// floor and ceiling heights under the mobj's bounding box. either out pointer may be NULL
+void level_mobjheights(object_t* mobj, float* floor, float* ceil);
 int level_nodeside(node_t* node, float x, float y);
 int level_lineside(linedef_t* line, float x, float y);
 ssector_t* level_getpointssector(float x, float y);
+// true if the REJECT lump says nothing in from can see into to
+bool level_rejected(sector_t* from, sector_t* to);
 float level_getlowestneighborceil(sector_t* sec);
 float level_getlowestneighborfloor(sector_t* sec);
 float level_gethighestneighborfloor(sector_t* sec);
-bool level_mobjstuckinblock(int bx, int by);
 void level_setmobjstate(object_t* obj, statenum_t state);
 void level_damagemobj(object_t* obj, int dmg, object_t* inflictor, object_t* src);
 float level_linelower(linedef_t* line);
 float level_lineupper(linedef_t* line);
 bool level_mobjstuckinsector(sector_t* sector);
+// whether any sector under the mobj's bounding box has a door or lift moving it
+bool level_mobjonmover(object_t* mobj);
 void level_trigger(object_t* user, int sectag, int special);
 void level_addmobjthinker(object_t* obj);
+// puts a sleeping mobj's thinker back on the active list.
+// idle mobjs (no pending state change, no velocity) sleep until damaged,
+// their state is set, the floor or ceiling under them moves, or this is called
+void level_wakemobj(object_t* obj);
+// wakes every mobj touching the sector, call when its heights change
+void level_wakesector(sector_t* sector);
+// the mobj a thinker belongs to, NULL if it isn't a mobj thinker
+object_t* level_thinkermobj(thinker_t* thinker);
+void level_queuefx(levelfxqueue_t* queue, levelfx_e type, object_t* obj, int amount, object_t* inflictor, object_t* src);
+// applies and clears the queue
+void level_applyfx(levelfxqueue_t* queue);
 void level_removemobj(object_t* obj);
 void level_load(int episode, int map);
 
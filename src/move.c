@@ -9,38 +9,38 @@ void move(object_t* mobj, float ft)
     move_z(mobj, ft);
 }
 
-bool collided;
-object_t *movemobj;
-
-angle_t slideangle;
-float disttowall;
+typedef struct
+{
+    object_t *mobj;
+} movectx_t;
 
-static void move_explodemissile(void)
+static void move_explodemissile(object_t* mobj)
 {
-    movemobj->info.xvel = movemobj->info.yvel = movemobj->info.zvel = 0;
-    movemobj->info.flags &= ~MF_MISSILE;
-    level_setmobjstate(movemobj, mobjinfo[movemobj->info.type].deathstate);
-    if(mobjinfo[movemobj->info.type].deathsound)
-        snd_queueedict(mobjinfo[movemobj->info.type].deathsound, movemobj - mobjs);
+    mobj->info.xvel = mobj->info.yvel = mobj->info.zvel = 0;
+    mobj->info.flags &= ~MF_MISSILE;
+    level_setmobjstate(mobj, mobjinfo[mobj->info.type].deathstate);
+    if(mobjinfo[mobj->info.type].deathsound)
+        snd_queueedict(mobjinfo[mobj->info.type].deathsound, mobj - mobjs);
 }
 
-static void move_validposline(linedef_t* line)
+// distance kept between a sliding mobj and whatever it slid along
+#define SLIDESKIN 0.03125
+#define MAXSLIDES 3
+
+static bool move_lineblocks(linedef_t* line, void* ctx)
 {
+    object_t *movemobj;
     float lower, upper;
 
-    if(collided)
-        return;
+    movemobj = ((movectx_t*) ctx)->mobj;
 
     if(!line->front && !line->back)
-        return;
+        return false;
 
     if((line->flags & LINEDEF_BLOCKALL)
     || (!movemobj->player && (line->flags & LINEDEF_BLOCKMONSTERS))
     || !line->front || !line->back)
-    {
-        collided = true;
-        return;
-    }
+        return true;
 
     lower = level_linelower(line);
     upper = level_lineupper(line);
@@ -48,217 +48,111 @@ static void move_validposline(linedef_t* line)
     if(upper - lower < movemobj->info.height
     || upper - movemobj->info.z < movemobj->info.height
     || lower - movemobj->info.z > 24)
-    {
-        collided = true;
-        return;
-    }
+        return true;
+
+    return false;
 }
 
-static void move_validposmobj(object_t* mobj)
+// solid mobjs block a sweep, except the mover itself and a missile's shooter
+static bool move_sweepmobj(object_t* mobj, void* ctx)
 {
-    if(collided)
-        return;
+    object_t *movemobj;
+
+    movemobj = ((movectx_t*) ctx)->mobj;
 
     if(!(mobj->info.flags & MF_SOLID))
-        return;
-    
+        return false;
+
     if(mobj == movemobj)
-        return;
+        return false;
 
     if((movemobj->info.flags & MF_MISSILE) && mobj == movemobj->target)
-        return;
-
-    if(movemobj->info.flags & MF_MISSILE)
-        level_damagemobj(mobj, mobjinfo[movemobj->info.type].damage, movemobj, movemobj->target);
-
-    collided = true;
-}
+        return false;
 
-static bool move_validpos(object_t* mobj, float x, float y)
-{
-    collided = false;
-    level_thingcollisions(x, y, mobjinfo[mobj->info.type].radius, move_validposline, move_validposmobj);
-    return !collided;
+    return true;
 }
 
-static bool player_slidecollider(float x1, float y1, float x2, float y2, linedef_t* line, float t)
+// how far along (dx, dy) to go to stop SLIDESKIN short of the contact, measured along the normal
+static float move_contact(float dx, float dy, const sweephit_t* hit)
 {
-    float ldx, ldy;
-    float floorheight, ceilheight;
-
-    if(line->flags & LINEDEF_BLOCKALL)
-        goto hit;
-
-    if(!line->front && !line->back)
-        return false;
-
-    floorheight = level_linelower(line);
-    ceilheight = level_lineupper(line);
-
-    if(floorheight - movemobj->info.z > 24)
-        goto hit;
-
-    if(ceilheight - floorheight < movemobj->info.height)
-        goto hit;
-
-    if(ceilheight - movemobj->info.z < movemobj->info.height)
-        goto hit;
-
-    return false;
-
-hit:
-    ldx = line->v2->x - line->v1->x;
-    ldy = line->v2->y - line->v1->y;
-    slideangle = ANGATAN2(ldy, ldx);
-    disttowall = t;
+    float t, into;
 
-    return true;
+    t = hit->t;
+    into = -(dx * hit->nx + dy * hit->ny);
+    if(into > 0)
+        t -= SLIDESKIN / into;
+    return MAX(t, 0);
 }
 
 static void move_slide(object_t* mobj, float ft)
 {
-    int trycount;
-    float leadx, leady, trailx, traily;
-    float bestdist;
-    float velx, vely, x, y, tryx, tryy;
-    float tox, toy, remx, remy, projx, projy;
-    float linex, liney, dot;
-    angle_t bestslideang;
-    bool hitanything;
-
-    velx = mobj->info.xvel * ft;
-    vely = mobj->info.yvel * ft;
-    x = mobj->info.x;
-    y = mobj->info.y;
-
-    trycount = 0;
-attempt:
-    if(++trycount >= 3)
-        goto tryaxis;
+    int i;
+    float radius;
+    float x, y, dx, dy;
+    float t, dot;
+    sweephit_t hit;
+    movectx_t move;
 
-    leadx = mobj->info.x;
-    trailx = mobj->info.x;
-    if(mobj->info.xvel > 0)
-    {
-        leadx += mobjinfo[mobj->info.type].radius;
-        trailx -= mobjinfo[mobj->info.type].radius;
-    }
-    else
-    {
-        leadx -= mobjinfo[mobj->info.type].radius;
-        trailx += mobjinfo[mobj->info.type].radius;
-    }
-    leady = mobj->info.y;
-    traily = mobj->info.y;
-    if(mobj->info.yvel > 0)
-    {
-        leady += mobjinfo[mobj->info.type].radius;
-        traily -= mobjinfo[mobj->info.type].radius;
-    }
-    else
-    {
-        leady -= mobjinfo[mobj->info.type].radius;
-        traily += mobjinfo[mobj->info.type].radius;
-    }
+    move.mobj = mobj;
 
-    hitanything = false;
-    bestdist = INFINITY;
-    bestslideang = 0;
+    radius = mobjinfo[mobj->info.type].radius;
+    x = mobj->info.x;
+    y = mobj->info.y;
+    dx = mobj->info.xvel * ft;
+    dy = mobj->info.yvel * ft;
 
-    if(level_traverseline(leadx, leady, leadx+velx, leady+vely, false, player_slidecollider, NULL))
-    {
-        hitanything = true;
-        if(disttowall < bestdist)
-        {
-            bestdist = disttowall;
-            bestslideang = slideangle;
-        }
-    }
-    if(level_traverseline(trailx, leady, trailx+velx, leady+vely, false, player_slidecollider, NULL))
-    {
-        hitanything = true;
-        if(disttowall < bestdist)
-        {
-            bestdist = disttowall;
-            bestslideang = slideangle;
-        }
-    }
-    if(level_traverseline(leadx, traily, leadx+velx, traily+vely, false, player_slidecollider, NULL))
+    for(i=0; i<MAXSLIDES && (dx || dy); i++)
     {
-        hitanything = true;
-        if(disttowall < bestdist)
+        if(!level_sweepbox(x, y, radius, dx, dy, move_lineblocks, move_sweepmobj, &move, &hit))
         {
-            bestdist = disttowall;
-            bestslideang = slideangle;
+            x += dx;
+            y += dy;
+            break;
         }
-    }
-
-    if(!hitanything)
-        goto tryaxis;
 
-    bestdist -= 0.01;
-    tox = velx * bestdist;
-    toy = vely * bestdist;
-    remx = velx - tox;
-    remy = vely - toy;
+        t = move_contact(dx, dy, &hit);
 
-    linex = ANGCOS(bestslideang);
-    liney = ANGSIN(bestslideang);
+        if(mobj->player)
+            mobj->player->paths |= hit.mobj ? PATH_SLIDEMOBJ : PATH_SLIDE;
 
-    dot = remx * linex + remy * liney;
-    projx = linex * dot;
-    projy = liney * dot;
+        x += dx * t;
+        y += dy * t;
 
-    velx = tox + projx;
-    vely = toy + projy;
-    
-    tryx = x + velx;
-    tryy = y + vely;
-    if(move_validpos(mobj, tryx, tryy))
-        goto moved;
-    goto attempt;
-
-tryaxis:
-    tryx = x + velx;
-    tryy = y;
-    if(move_validpos(mobj, tryx, tryy))
-    {
-        level_unplacemobj(mobj);
-        mobj->info.x = tryx;
-        mobj->info.y = tryy;
-        level_placemobj(mobj);
-        return;
-    }
+        // whatever is left of the move continues along the blocker
+        dx *= 1 - t;
+        dy *= 1 - t;
+        dot = dx * hit.nx + dy * hit.ny;
+        dx -= dot * hit.nx;
+        dy -= dot * hit.ny;
 
-    tryx = x;
-    tryy = y + vely;
-    if(move_validpos(mobj, tryx, tryy))
-    {
-        level_unplacemobj(mobj);
-        mobj->info.x = tryx;
-        mobj->info.y = tryy;
-        level_placemobj(mobj);
-        return;
+        dot = mobj->info.xvel * hit.nx + mobj->info.yvel * hit.ny;
+        if(dot < 0)
+        {
+            mobj->info.xvel -= dot * hit.nx;
+            mobj->info.yvel -= dot * hit.ny;
+        }
     }
 
-    tryx = x;
-    tryy = y;
-moved:
     level_unplacemobj(mobj);
-    mobj->info.x = tryx;
-    mobj->info.y = tryy;
+    mobj->info.x = x;
+    mobj->info.y = y;
     level_placemobj(mobj);
-    mobj->info.xvel = projx / ft;
-    mobj->info.yvel = projy / ft;
 }
 
+// log2 of the 0.90625 per tic ground friction
+#define FRICTIONLOG2 -9307
+
 void move_xy(object_t* mobj, float ft)
 {
-    float remx, remy, tryx, tryy;
+    float remx, remy, stepx, stepy;
     float framefric;
+    float floor;
+    float t;
     bool split;
+    sweephit_t hit;
+    movectx_t move;
 
-    movemobj = mobj;
+    move.mobj = mobj;
 
     mobj->info.xvel = CLAMP(mobj->info.xvel, -30 * 35, 30 * 35);
     mobj->info.yvel = CLAMP(mobj->info.yvel, -30 * 35, 30 * 35);
@@ -274,43 +168,54 @@ void move_xy(object_t* mobj, float ft)
         {
             remx *= 0.5;
             remy *= 0.5;
-            tryx = mobj->info.x + remx;
-            tryy = mobj->info.y + remy;
+            stepx = remx;
+            stepy = remy;
             split = true;
         }
         else
         {
-            tryx = mobj->info.x + remx;
-            tryy = mobj->info.y + remy;
+            stepx = remx;
+            stepy = remy;
             remx = remy = 0;
             split = false;
         }
 
-        if(move_validpos(mobj, tryx, tryy))
+        // the step is swept too, so a fast missile can't pass through a thin wall or a thing
+        if(!level_sweepbox(mobj->info.x, mobj->info.y, mobjinfo[mobj->info.type].radius,
+        stepx, stepy, move_lineblocks, move_sweepmobj, &move, &hit))
         {
-            level_unplacemobj(mobj);
-            mobj->info.x = tryx;
-            mobj->info.y = tryy;
-            level_placemobj(mobj);
+            mobj->info.x += stepx;
+            mobj->info.y += stepy;
+            level_relinkmobj(mobj);
         }
+        else if(mobj->player)
+            move_slide(mobj, ft);
         else
         {
-            if(mobj->player)
-                move_slide(mobj, ft);
-            else
+            t = move_contact(stepx, stepy, &hit);
+            mobj->info.x += stepx * t;
+            mobj->info.y += stepy * t;
+            level_relinkmobj(mobj);
+
+            mobj->info.xvel = mobj->info.yvel = 0;
+            if(mobj->info.flags & MF_MISSILE)
             {
-                mobj->info.xvel = mobj->info.yvel = 0;
-                if(mobj->info.flags & MF_MISSILE)
-                    move_explodemissile();
-                break;
+                if(hit.mobj)
+                    level_damagemobj(hit.mobj, mobjinfo[mobj->info.type].damage, mobj, mobj->target);
+                move_explodemissile(mobj);
             }
+            break;
         }
     } while(split);
 
-    level_mobjheights(mobj);
-    if(mobj->info.z <= mobjfloorheight)
+    level_mobjheights(mobj, &floor, NULL);
+    if(mobj->info.z <= floor)
     {
+#ifdef FIXEDSIM
+        framefric = FIXEDTOFLOAT(fixedexp2(fixedmul(FRICTIONLOG2, FLOATTOFIXED(35.0f * ft))));
+#else
         framefric = powf(0.90625, 35.0f * ft);
+#endif
         mobj->info.xvel *= framefric;
         mobj->info.yvel *= framefric;
     }
@@ -331,32 +236,32 @@ void move_xy(object_t* mobj, float ft)
 
 void move_z(object_t* mobj, float ft)
 {
-    movemobj = mobj;
+    float floor, ceil;
 
-    level_mobjheights(mobj);
+    level_mobjheights(mobj, &floor, &ceil);
 
     if(!(mobj->info.flags & MF_NOGRAVITY))
         mobj->info.zvel -= 1225 * ft;
     
     mobj->info.z += mobj->info.zvel * ft;
     
-    if(mobj->info.z <= mobjfloorheight)
+    if(mobj->info.z <= floor)
     {
         if(mobj->info.flags & MF_MISSILE)
-            move_explodemissile();
+            move_explodemissile(mobj);
 
         if(mobj->player
         && mobj->info.zvel < -1225.0 * 8.0 / 35.0)
             deltaviewheight = mobj->info.zvel / 35.0 / 8.0;
 
-        mobj->info.z = mobjfloorheight;
+        mobj->info.z = floor;
         mobj->info.zvel = 0;
     }
-    else if(mobj->info.z + mobj->info.height >= mobjceilheight)
+    else if(mobj->info.z + mobj->info.height >= ceil)
     {
         if(mobj->info.flags & MF_MISSILE)
-            move_explodemissile();
-        mobj->info.z = mobjceilheight - mobj->info.height;
+            move_explodemissile(mobj);
+        mobj->info.z = ceil - mobj->info.height;
         mobj->info.zvel = 0;
     }
 }
\ No newline at end of file
@@ -3,6 +3,7 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
 
 #define NET_MAX_PACKET_SIZE 8192
 
@@ -26,11 +27,26 @@ typedef struct
 {
     uint8_t* data;
     int len, cap;
+    bool fixed; // data isn't ours, it's never grown or freed
+    bool overflow; // a write didn't fit in a fixed buffer and was dropped
 } netbuf_t;
 
 extern bool netpacketfull;
 
+// heap buffer, grows as needed
 void netbuf_init(netbuf_t* buf);
+// writes go into data and stop at cap
+void netbuf_initstatic(netbuf_t* buf, void* data, int cap);
+// cap bytes from the scratch pool, good until netbuf_resetscratch.
+// falls back to a heap buffer if the pool is used up, so still netbuf_free it
+void netbuf_initscratch(netbuf_t* buf, int cap);
+// hands the whole scratch pool back, call once per tic
+void netbuf_resetscratch(void);
+// makes sure len more bytes fit. returns false (and flags overflow) if they can't,
+// otherwise the netbuf_put functions can be used for those bytes
+bool netbuf_reserve(netbuf_t* buf, int len);
+// whether len more bytes would fit, without flagging overflow if they wouldn't
+bool netbuf_fits(const netbuf_t* buf, int len);
 void netbuf_writeu8(netbuf_t* buf, uint8_t val);
 void netbuf_writei8(netbuf_t* buf, int8_t val);
 void netbuf_writeu16(netbuf_t* buf, uint16_t val);
@@ -40,9 +56,44 @@ void netbuf_writei32(netbuf_t* buf, int32_t val);
 void netbuf_writeu64(netbuf_t* buf, uint64_t val);
 void netbuf_writei64(netbuf_t* buf, int64_t val);
 void netbuf_writefloat(netbuf_t* buf, float val);
-void netbuf_writedata(netbuf_t* buf, void* data, int len);
+void netbuf_writedata(netbuf_t* buf, const void* data, int len);
 void netbuf_free(netbuf_t* buf);
 
+// unchecked writes, only for space already taken with netbuf_reserve
+
+static inline void netbuf_putu8(netbuf_t* buf, uint8_t val)
+{
+    buf->data[buf->len++] = val;
+}
+
+static inline void netbuf_putu16(netbuf_t* buf, uint16_t val)
+{
+    buf->data[buf->len++] = val >> 8;
+    buf->data[buf->len++] = val;
+}
+
+static inline void netbuf_putu32(netbuf_t* buf, uint32_t val)
+{
+    buf->data[buf->len++] = val >> 24;
+    buf->data[buf->len++] = val >> 16;
+    buf->data[buf->len++] = val >> 8;
+    buf->data[buf->len++] = val;
+}
+
+static inline void netbuf_putfloat(netbuf_t* buf, float val)
+{
+    uint32_t bits;
+
+    memcpy(&bits, &val, sizeof(bits));
+    netbuf_putu32(buf, bits);
+}
+
+static inline void netbuf_putdata(netbuf_t* buf, const void* data, int len)
+{
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+}
+
 uint8_t net_readu8(void* data, void* pos, int datalen);
 int8_t net_readi8(void* data, void* pos, int datalen);
 uint16_t net_readu16(void* data, void* pos, int datalen);
@@ -59,12 +110,23 @@ void net_readdata(void* outdata, int len, void* data, void* pos, int datalen);
 // Client: sets up the receive queue (call connectToGame() from JS to actually connect).
 void net_init(void);
 
+// Seconds on a monotonic clock, for timing packets.
+double net_time(void);
+
 // Returns the number of bytes sent, or -1 if not connected.
 int net_send(int dc, const void *data, int size);
 
+// Returns the number of bytes queued on the data channel that haven't gone out yet.
+int net_buffered(int dc);
+
 // Returns the number of packets sitting in the receive queue.
 int net_recv_pending(void);
 
+// Returns the next queued packet where it sits, without copying it (client only).
+// It stays put until net_recvrelease, which drops it. Returns NULL if the queue is empty.
+void *net_recvinplace(int *size_out, int *dc_out);
+void net_recvrelease(void);
+
 // Copies the next queued packet into buf (up to buf_size bytes).
 // Sets *dc_out to the data channel id the packet arrived on (if dc_out is non-NULL).
 // Returns the packet size, or 0 if the queue is empty.
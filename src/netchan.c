@@ -1,148 +1,598 @@
 #include "netchan.h"
 
+#include <math.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "doommath.h"
 #include "net.h"
 
-static void netchan_trytransfermsg(netchan_t* state)
+void (*netchan_capture)(const netchan_t* state, bool out, const void* data, int len) = NULL;
+
+static netblock_t* netchan_msg(netchan_t* state, int i)
+{
+    return &state->msgs[(state->firstmsg + i) % state->maxmsg];
+}
+
+// contiguous free bytes in the ring starting at pos
+static int32_t netchan_roomat(netchan_t* state, int32_t pos)
+{
+    int32_t tail;
+
+    if(!state->nmsg)
+        return state->ringsize - pos;
+
+    tail = netchan_msg(state, 0)->start;
+    if(pos > tail)
+        return state->ringsize - pos;
+    return tail - pos;
+}
+
+// grows the ring so at least len more bytes fit past the last block.
+// blocks are packed to the front in order, which unwraps the ring
+static void netchan_growring(netchan_t* state, int32_t len)
 {
-    if(!state->reliablesize && state->nmsg && state->msgsizes[0])
+    int i;
+
+    uint8_t *ring;
+    int32_t size, used;
+    netblock_t *msg;
+
+    used = 0;
+    for(i=0; i<state->nmsg; i++)
+        used += netchan_msg(state, i)->len;
+
+    size = state->ringsize ? state->ringsize * 2 : MAX_PACKET;
+    while(size < used + len)
+        size *= 2;
+
+    ring = malloc(size);
+    used = 0;
+    for(i=0; i<state->nmsg; i++)
     {
-        state->reliablesize = state->msgsizes[0];
-        memcpy(state->reliable, state->msg[0], state->reliablesize);
+        msg = netchan_msg(state, i);
+        memcpy(ring + used, state->ring + msg->start, msg->len);
+        msg->start = used;
+        used += msg->len;
+    }
+
+    free(state->ring);
+    state->ring = ring;
+    state->ringsize = size;
+}
+
+static void netchan_growmsgs(netchan_t* state)
+{
+    int i;
+
+    netblock_t *msgs;
+    int32_t max;
+
+    max = state->maxmsg ? state->maxmsg * 2 : 8;
+    msgs = malloc(max * sizeof(netblock_t));
+    for(i=0; i<state->nmsg; i++)
+        msgs[i] = *netchan_msg(state, i);
+
+    free(state->msgs);
+    state->msgs = msgs;
+    state->maxmsg = max;
+    state->firstmsg = 0;
+}
+
+// marks everything the peer says it has, then drops acked blocks off the front
+static void netchan_ackreliable(netchan_t* state, int32_t relack, uint32_t relackbits)
+{
+    int i;
+
+    netblock_t *msg;
+    int32_t relseq;
+
+    for(i=0; i<state->nmsg && i<RELIABLE_WINDOW; i++)
+    {
+        msg = netchan_msg(state, i);
+        relseq = state->relacked + 1 + i;
+
+        if(relseq <= relack)
+            msg->acked = true;
+        else if(relseq - relack - 1 < 32 && (relackbits & (1U << (relseq - relack - 1))))
+            msg->acked = true;
+    }
+
+    while(state->nmsg && netchan_msg(state, 0)->acked)
+    {
+        state->firstmsg = (state->firstmsg + 1) % state->maxmsg;
         state->nmsg--;
+        state->relacked++;
+        state->justgotack = true;
+    }
+}
+
+// stashes a chunk until everything before it has arrived
+static void netchan_recvchunk(netchan_t* state, int32_t relseq, void* data, int len, bool more)
+{
+    int slot;
+
+    if(relseq <= state->inrelseq || relseq > state->inrelseq + RELIABLE_WINDOW)
+        return;
+
+    slot = relseq % RELIABLE_WINDOW;
+    if(state->pendinghave[slot])
+        return;
+
+    memcpy(state->pending[slot], data, len);
+    state->pendinglen[slot] = len;
+    state->pendingmore[slot] = more;
+    state->pendinghave[slot] = true;
+}
+
+// takes every chunk that's now in order, passing on whole messages
+static void netchan_deliverreliable(netchan_t* state)
+{
+    int slot;
+
+    slot = (state->inrelseq + 1) % RELIABLE_WINDOW;
+    while(state->pendinghave[slot])
+    {
+        if(!state->partial.data)
+            netbuf_init(&state->partial);
+        netbuf_writedata(&state->partial, state->pending[slot], state->pendinglen[slot]);
+        state->pendinghave[slot] = false;
+        state->inrelseq++;
+
+        if(!state->pendingmore[slot])
+        {
+            netbuf_writedata(&state->payload, state->partial.data, state->partial.len);
+            state->partial.len = 0;
+        }
+
+        slot = (state->inrelseq + 1) % RELIABLE_WINDOW;
+    }
+}
+
+// returns true once the set seq belongs to is complete
+static bool netchan_recvfragment(netchan_t* state, int32_t seq, int index, int count, void* data, int len)
+{
+    int32_t base;
+
+    if(count < 1 || index >= count || len > MAX_CHUNK || (index < count - 1 && len != MAX_CHUNK))
+        return false;
+
+    base = seq - index;
+
+    // older than the set being collected
+    if(state->fragcount && base < state->fragbase)
+        return false;
+
+    // a newer set replaces whatever was left of the old one
+    if(!state->fragcount || base > state->fragbase)
+    {
+        if(!state->fragdata)
+            state->fragdata = malloc(MAX_FRAGMENTS * MAX_CHUNK);
+        state->fragbase = base;
+        state->fragcount = count;
+        state->fraggot = state->fraglen = 0;
+        memset(state->fraghave, 0, sizeof(state->fraghave));
+    }
+
+    if(count != state->fragcount || state->fraghave[index])
+        return false;
+
+    memcpy(state->fragdata + index * MAX_CHUNK, data, len);
+    state->fraghave[index] = true;
+    state->fraggot++;
+    state->fraglen += len;
+
+    return state->fraggot == state->fragcount;
+}
+
+// the peer got ack, and each of the 32 before it that has its bit set
+static void netchan_markacked(netchan_t* state, int32_t ack, uint32_t ackbits)
+{
+    int i;
+
+    int32_t seq;
+    int slot;
+
+    for(i=-1; i<32; i++)
+    {
+        if(i >= 0 && !(ackbits & (1u << i)))
+            continue;
+
+        seq = ack - 1 - i;
+        slot = seq % NETSTATS_TIMES;
+        if(seq > 0 && state->stats.sendseqs[slot] == seq)
+            state->stats.sendacked[slot] = true;
+    }
+}
+
+static void netchan_seen(netchan_t* state, int32_t seq)
+{
+    int32_t shift;
+
+    shift = seq - state->lastseen;
+    if(state->lastseen)
+    {
+        state->seenbits = shift < 32 ? state->seenbits << shift : 0;
+        if(shift <= 32)
+            state->seenbits |= 1u << (shift - 1);
+    }
+    state->lastseen = seq;
+}
+
+bool netchan_acked(const netchan_t* state, int32_t seq)
+{
+    int slot;
 
-        memmove(&state->msg[0], &state->msg[1], state->nmsg * MAX_PACKET);
+    slot = seq % NETSTATS_TIMES;
+    return seq > 0 && state->stats.sendseqs[slot] == seq && state->stats.sendacked[slot];
+}
+
+// call before inack moves
+static void netchan_countrecv(netchan_t* state, int32_t seq, int32_t ack, int len)
+{
+    netstats_t *stats;
+    float sample;
+    int slot;
+    int32_t shift;
+    uint32_t bit;
+
+    stats = &state->stats;
+    stats->bytesin += len;
+
+    if(seq > stats->inseq)
+    {
+        stats->received++;
+        if(stats->inseq)
+        {
+            shift = seq - stats->inseq;
+            stats->lost += shift - 1;
+            stats->inbits = shift < 32 ? stats->inbits << shift : 0;
+            if(shift <= 32)
+                stats->inbits |= 1u << (shift - 1);
+        }
+        stats->inseq = seq;
+    }
+    else if(seq < stats->inseq && stats->inseq - seq <= 32)
+    {
+        // a late one was counted lost when something newer got here first, a duplicate wasn't
+        bit = 1u << (stats->inseq - seq - 1);
+        if(!(stats->inbits & bit))
+        {
+            stats->inbits |= bit;
+            stats->received++;
+            if(stats->lost > 0)
+                stats->lost--;
+        }
+    }
+
+    // the first time the peer acks a packet, it's been a round trip since we sent it
+    slot = ack % NETSTATS_TIMES;
+    if(ack <= state->inack || stats->sendseqs[slot] != ack)
+        return;
+
+    sample = net_time() - stats->sendtimes[slot];
+    if(!stats->rtt)
+    {
+        stats->rtt = sample;
+        stats->jitter = sample / 2;
+        return;
     }
+
+    stats->jitter += (fabsf(sample - stats->rtt) - stats->jitter) / 4;
+    stats->rtt += (sample - stats->rtt) / 8;
 }
 
-void* netchan_recv(netchan_t* state, void* data, int datalen)
+void* netchan_recv(netchan_t* state, void* data, int datalen, int* payloadlen)
 {
-    int32_t seq, ack;
-    bool reliable, whichreliable;
+    int i;
+
+    int32_t seq, ack, relack, relseq;
+    uint32_t ackbits, relackbits;
+    int nchunks, chunklen, fragindex, fragcount;
+    bool stale, more, fragment;
 
     void *curpos;
 
     state->justgotack = false;
-    state->gotnewreliable = false;
+
+    if(netchan_capture)
+        netchan_capture(state, false, data, datalen);
 
     curpos = data;
     seq = net_readi32(data, curpos, datalen);
     curpos += 4;
     ack = net_readi32(data, curpos, datalen);
     curpos += 4;
+    ackbits = net_readu32(data, curpos, datalen);
+    curpos += 4;
 
     // skip qport
     curpos += 2;
 
+    relack = net_readi32(data, curpos, datalen);
+    curpos += 4;
+    relackbits = net_readu32(data, curpos, datalen);
+    curpos += 4;
+    nchunks = net_readu8(data, curpos++, datalen);
+
     if(netpacketfull)
         return NULL;
 
-    reliable = ((uint32_t)seq >> 31) & 1;
-    whichreliable = ((uint32_t)seq >> 30) & 1;
-    seq &= 0x3FFFFFFF;
+    fragment = ((uint32_t) seq >> 31) & 1;
+    seq &= 0x7FFFFFFF;
 
-    // we already got a newer packet
-    if(seq <= state->lastseen)
-        return NULL;
+    netchan_countrecv(state, seq, ack, datalen);
+    netchan_markacked(state, ack, ackbits);
 
-    state->inackreliable = ack >> 31;
-    state->inack = ack & 0x7FFFFFFF;
+    // older packets still carry good reliable data and acks, just not unreliable data
+    stale = seq <= state->lastseen;
+    if(!stale && ack > state->inack)
+    {
+        state->inack = ack;
+        state->inackbits = ackbits;
+    }
 
-    state->lastseen = seq;
-    state->hadreliable = reliable;
+    netchan_ackreliable(state, relack, relackbits);
 
-    if(state->inack >= state->lastsentreliable && state->lastsentreliable)
+    if(!state->payload.data)
+        netbuf_init(&state->payload);
+    state->payload.len = 0;
+
+    for(i=0; i<nchunks; i++)
     {
-        state->justgotack = true;
-        state->reliablesize = state->lastsentreliable = 0;
+        relseq = net_readi32(data, curpos, datalen);
+        curpos += 4;
+        chunklen = net_readu16(data, curpos, datalen);
+        curpos += 2;
+        more = chunklen & 0x8000;
+        chunklen &= 0x7FFF;
+        if(netpacketfull || chunklen > MAX_CHUNK || datalen - (int) (curpos - data) < chunklen)
+            return NULL;
+
+        netchan_recvchunk(state, relseq, curpos, chunklen, more);
+        curpos += chunklen;
     }
 
-    netchan_trytransfermsg(state);
+    netchan_deliverreliable(state);
 
-    if(reliable)
+    if(fragment)
     {
-        // same toggle bit as last time = retransmit, drop payload
-        if(whichreliable == state->inreliable)
+        fragindex = net_readu8(data, curpos++, datalen);
+        fragcount = net_readu8(data, curpos++, datalen);
+        if(netpacketfull)
             return NULL;
 
-        state->gotnewreliable = true;
-        state->inreliable = whichreliable;
+        // the set counts as seen once all of it is here, so acks only ever cover whole snapshots
+        if(!stale && netchan_recvfragment(state, seq, fragindex, fragcount, curpos, datalen - (curpos - data)))
+        {
+            netchan_seen(state, state->fragbase + state->fragcount - 1);
+            state->fragcount = 0;
+            netbuf_writedata(&state->payload, state->fragdata, state->fraglen);
+        }
+    }
+    else if(!stale)
+    {
+        netchan_seen(state, seq);
+        if(datalen > curpos - data)
+            netbuf_writedata(&state->payload, curpos, datalen - (curpos - data));
+    }
+
+    if(stale && !state->payload.len)
+        return NULL;
+
+    *payloadlen = state->payload.len;
+    return state->payload.data;
+}
+
+static void netchan_transmit(netchan_t* state, int dc, netbuf_t* buf)
+{
+    state->stats.bytesout += buf->len;
+    if(netchan_capture)
+        netchan_capture(state, true, buf->data, buf->len);
+    net_send(dc, buf->data, buf->len);
+}
+
+static void netchan_beginpacket(netchan_t* state, netbuf_t* buf, uint8_t* packet, bool fragment)
+{
+    int i;
+
+    uint32_t seq, relackbits;
+
+    state->outseq++;
+    seq = state->outseq;
+    if(fragment)
+        seq |= 0x80000000U;
+
+    relackbits = 0;
+    for(i=0; i<RELIABLE_WINDOW; i++)
+        if(state->pendinghave[(state->inrelseq + 1 + i) % RELIABLE_WINDOW])
+            relackbits |= 1U << i;
+
+    state->stats.sendseqs[state->outseq % NETSTATS_TIMES] = state->outseq;
+    state->stats.sendtimes[state->outseq % NETSTATS_TIMES] = net_time();
+    state->stats.sendacked[state->outseq % NETSTATS_TIMES] = false;
+
+    netbuf_initstatic(buf, packet, MAX_PACKET);
+    netbuf_writeu32(buf, seq);
+    netbuf_writei32(buf, state->lastseen);
+    netbuf_writeu32(buf, state->seenbits);
+    netbuf_writei16(buf, 0);
+    netbuf_writei32(buf, state->inrelseq);
+    netbuf_writeu32(buf, relackbits);
+}
+
+// new chunks, and chunks whose packet the peer has seen past without acking them.
+// returns how many were written
+static int netchan_writechunks(netchan_t* state, netbuf_t* buf)
+{
+    int i;
+
+    int nchunkspos, nchunks;
+    netblock_t *msg;
+
+    nchunkspos = buf->len;
+    netbuf_writeu8(buf, 0);
+
+    nchunks = 0;
+    for(i=0; i<state->nmsg && i<RELIABLE_WINDOW; i++)
+    {
+        msg = netchan_msg(state, i);
+        if(msg->acked)
+            continue;
+        if(msg->lastsent && msg->lastsent > state->inack)
+            continue;
+        if(buf->len + 6 + msg->len > MAX_PACKET)
+            break;
+
+        netbuf_writei32(buf, state->relacked + 1 + i);
+        netbuf_writeu16(buf, msg->len | (msg->more ? 0x8000 : 0));
+        netbuf_writedata(buf, state->ring + msg->start, msg->len);
+        msg->lastsent = state->outseq;
+        nchunks++;
     }
 
-    return curpos;
+    buf->data[nchunkspos] = nchunks;
+    return nchunks;
 }
 
 bool netchan_send(netchan_t* state, int dc, const netbuf_t* unreliable)
 {
+    int i;
+
+    uint8_t packet[MAX_PACKET];
     netbuf_t buf;
-    uint32_t seq, ack;
-    bool sendreliable;
-    bool sentunreliable;
+    int nchunks, count, len;
+
+    // a snapshot that didn't fit its buffer would be garbage, send just the reliable data
+    if(unreliable && unreliable->overflow)
+        unreliable = NULL;
+
+    netchan_beginpacket(state, &buf, packet, false);
+    nchunks = netchan_writechunks(state, &buf);
 
-    netchan_trytransfermsg(state);
+    if(!unreliable || !unreliable->len || MAX_PACKET - buf.len > unreliable->len)
+    {
+        if(unreliable && unreliable->len)
+            netbuf_writedata(&buf, unreliable->data, unreliable->len);
+        netchan_transmit(state, dc, &buf);
+        return unreliable && unreliable->len;
+    }
 
-    sendreliable = state->reliablesize > 0;
+    // too big, the reliable chunks go on their own and the unreliable data is fragmented after.
+    // without any the packet isn't worth a sequence number, an ack of it wouldn't cover a snapshot
+    if(nchunks)
+        netchan_transmit(state, dc, &buf);
+    else
+        state->outseq--;
 
-    // toggle the which-reliable bit only when first sending a new reliable
-    if(sendreliable && !state->lastsentreliable)
-        state->outreliable = !state->outreliable;
+    count = (unreliable->len + MAX_CHUNK - 1) / MAX_CHUNK;
+    if(count > MAX_FRAGMENTS)
+        return false;
 
-    state->outseq++;
-    seq = (uint32_t) state->outseq;
-    if(sendreliable)
+    for(i=0; i<count; i++)
     {
-        seq |= 0x80000000U;
-        if(state->outreliable) seq |= 0x40000000U;
+        len = MIN(MAX_CHUNK, unreliable->len - i * MAX_CHUNK);
+
+        netchan_beginpacket(state, &buf, packet, true);
+        netbuf_writeu8(&buf, 0);
+        netbuf_writeu8(&buf, i);
+        netbuf_writeu8(&buf, count);
+        netbuf_writedata(&buf, unreliable->data + i * MAX_CHUNK, len);
+        netchan_transmit(state, dc, &buf);
     }
 
-    ack = (uint32_t) state->lastseen;
-    if(state->hadreliable)
-        ack |= 0x80000000U;
+    return true;
+}
 
-    netbuf_init(&buf);
-    netbuf_writeu32(&buf, seq);
-    netbuf_writeu32(&buf, ack);
-    netbuf_writei16(&buf, 0);
+static bool netchan_queueblock(netchan_t* state, const void* data, int len, bool more, bool coalesce)
+{
+    int32_t end;
+    netblock_t *last;
 
-    if(sendreliable)
-        netbuf_writedata(&buf, state->reliable, state->reliablesize);
+    last = state->nmsg ? netchan_msg(state, state->nmsg - 1) : NULL;
+    end = last ? last->start + last->len : 0;
 
-    sentunreliable = false;
-    if(unreliable && unreliable->len > 0 && MAX_PACKET - buf.len > unreliable->len)
+    // append to the newest block if it hasn't gone out yet and there's room
+    if(coalesce && last && !last->lastsent && !last->more
+    && last->len + len <= MAX_CHUNK && netchan_roomat(state, end) >= len)
     {
-        netbuf_writedata(&buf, unreliable->data, unreliable->len);
-        sentunreliable = true;
+        memcpy(state->ring + end, data, len);
+        last->len += len;
+        return true;
     }
 
-    net_send(dc, buf.data, buf.len);
-    netbuf_free(&buf);
+    if(state->nmsg >= state->maxmsg)
+        netchan_growmsgs(state);
+
+    if(netchan_roomat(state, end) < len)
+    {
+        // wrap to the front if the ring isn't already wrapped and the front has room
+        if(last && end > netchan_msg(state, 0)->start && netchan_msg(state, 0)->start >= len)
+            end = 0;
+        else
+        {
+            netchan_growring(state, len);
+            last = state->nmsg ? netchan_msg(state, state->nmsg - 1) : NULL;
+            end = last ? last->start + last->len : 0;
+        }
+    }
 
-    if(sendreliable && !state->lastsentreliable)
-        state->lastsentreliable = state->outseq;
+    last = netchan_msg(state, state->nmsg++);
+    last->start = end;
+    last->len = len;
+    last->lastsent = 0;
+    last->acked = false;
+    last->more = more;
+    memcpy(state->ring + end, data, len);
 
-    return sentunreliable;
+    return true;
 }
 
 bool netchan_queue(netchan_t* state, const netbuf_t* msg)
 {
-    if(state->nmsg && MAX_PACKET - state->msgsizes[state->nmsg-1] <= msg->len)
+    int i;
+
+    int nblocks, len;
+
+    if(!msg->len)
+        return true;
+
+    if(msg->overflow)
+        return false;
+
+    if(msg->len <= MAX_CHUNK)
     {
-        memcpy(&state->msg[state->nmsg-1][state->msgsizes[state->nmsg-1]], msg->data, msg->len);
-        state->msgsizes[state->nmsg-1] += msg->len;
+        if(state->nmsg >= MAX_MSGQUE)
+        {
+            state->msgoverflow = true;
+            return false;
+        }
+        return netchan_queueblock(state, msg->data, msg->len, false, true);
     }
-    else if(state->nmsg >= MAX_MSGQUE)
+
+    // big messages get blocks of their own, all but the last marked to continue
+    nblocks = (msg->len + MAX_CHUNK - 1) / MAX_CHUNK;
+    if(state->nmsg + nblocks > MAX_MSGQUE)
     {
         state->msgoverflow = true;
         return false;
     }
-    else
+
+    for(i=0; i<nblocks; i++)
     {
-        state->msgsizes[state->nmsg] = msg->len;
-        memcpy(&state->msg[state->nmsg], msg->data, msg->len);
-        state->nmsg++;
+        len = MIN(MAX_CHUNK, msg->len - i * MAX_CHUNK);
+        netchan_queueblock(state, msg->data + i * MAX_CHUNK, len, i < nblocks - 1, false);
     }
 
     return true;
 }
+
+void netchan_reset(netchan_t* state)
+{
+    netbuf_free(&state->partial);
+    netbuf_free(&state->payload);
+    free(state->fragdata);
+    free(state->ring);
+    free(state->msgs);
+    memset(state, 0, sizeof(netchan_t));
+}
@@ -7,41 +7,104 @@
 #include "net.h"
 
 #define MAX_PACKET 8192
-#define MAX_MSGQUE 64
+// most reliable blocks that can be waiting at once
+#define MAX_MSGQUE 1024
+// reliable blocks are coalesced up to this size, bigger messages are split into blocks this size.
+// also the size of unreliable fragments. well under what webrtc will carry in one message
+#define MAX_CHUNK 1200
+// an unreliable payload can be split into at most this many fragments
+#define MAX_FRAGMENTS 255
+// reliable blocks that can be in flight at once. must be <= 32 to fit the ack bits
+#define RELIABLE_WINDOW 8
+// send times are kept for this many of the newest outgoing packets
+#define NETSTATS_TIMES 128
+
+// a run of queued reliable bytes that goes out as one reliable chunk
+typedef struct
+{
+    int32_t start;
+    int32_t len;
+    int32_t lastsent; // outseq it last went out in, 0 if never sent
+    bool acked; // selectively acked, but something older is still outstanding
+    bool more; // the message continues in the next block
+} netblock_t;
+
+typedef struct
+{
+    float rtt; // seconds, smoothed. 0 until the first ack
+    float jitter; // smoothed deviation of rtt samples from rtt
+    int32_t inseq; // newest sequence that has come in, fragment or not
+    uint32_t inbits; // bit i is set if inseq - 1 - i came in
+    int32_t received, lost; // packets, lost is counted from sequence gaps
+    int64_t bytesin, bytesout; // whole packets, headers and all
+    double sendtimes[NETSTATS_TIMES];
+    int32_t sendseqs[NETSTATS_TIMES];
+    bool sendacked[NETSTATS_TIMES]; // the peer has acked it, directly or by an ack bit
+} netstats_t;
 
 typedef struct
 {
     int32_t outseq;
     int32_t lastseen;
-    int32_t lastsentreliable;
-    
-    int32_t inack;
-    bool hadreliable;
-    bool inackreliable;
+    // bit i is set if lastseen - 1 - i was taken in as well. goes out with lastseen as the ack
+    uint32_t seenbits;
 
-    // toggles with each new outgoing reliable message
-    bool outreliable;
-    // tracks the reliable bit of the last reliable we processed
-    bool inreliable;
+    int32_t inack;
+    uint32_t inackbits;
 
-    // on the last recv, a new (not retransmitted) reliable was received
-    bool gotnewreliable;
-    // on the last recv, a previously unacknowledged reliable was acknowledged
+    // on the last recv, the peer's cumulative reliable ack moved forward
     bool justgotack;
 
     bool msgoverflow;
 
-    int32_t nmsg;
-    int32_t msgsizes[MAX_MSGQUE];
-    uint8_t msg[MAX_MSGQUE][MAX_PACKET];
+    // queued reliable data. blocks are contiguous in a growable byte ring
+    // and indexed by a growable ring of netblock_t, oldest first.
+    // the oldest block has reliable sequence relacked + 1, the next relacked + 2 and so on
+    int32_t ringsize;
+    uint8_t *ring;
+    int32_t nmsg, firstmsg, maxmsg;
+    netblock_t *msgs;
+    int32_t relacked;
+
+    // incoming reliable stream. everything up to inrelseq has been taken in order,
+    // chunks that arrived ahead of a gap wait in pending[relseq % RELIABLE_WINDOW].
+    // the leading blocks of a split message collect in partial until its last block arrives
+    int32_t inrelseq;
+    uint8_t pending[RELIABLE_WINDOW][MAX_CHUNK];
+    int pendinglen[RELIABLE_WINDOW];
+    bool pendinghave[RELIABLE_WINDOW];
+    bool pendingmore[RELIABLE_WINDOW];
+    netbuf_t partial;
 
-    int32_t reliablesize;
-    uint8_t reliable[MAX_PACKET];
+    // the newest unreliable fragment set, its first fragment has sequence fragbase.
+    // fragment i lands at i * MAX_CHUNK
+    int32_t fragbase;
+    int fragcount, fraggot, fraglen;
+    bool fraghave[MAX_FRAGMENTS];
+    uint8_t *fragdata;
+
+    // the in-order reliable data then the unreliable data from the last recv
+    netbuf_t payload;
+
+    netstats_t stats;
 } netchan_t;
 
-// returns the location in data[] after reading the header (where the data starts)
-void* netchan_recv(netchan_t* state, void* data, int datalen);
+// if set, called with every datagram a channel sends (out true) or is handed to recv
+extern void (*netchan_capture)(const netchan_t* state, bool out, const void* data, int len);
+
+// returns the payload of the packet (new reliable data, then unreliable data) and its length
+// in *payloadlen, or NULL if the packet was bad or carried nothing new.
+// reliable messages only show up once all their blocks are in, and unreliable data that was
+// fragmented only shows up with its last missing fragment.
+// the payload belongs to the channel and is only good until the next recv
+void* netchan_recv(netchan_t* state, void* data, int datalen, int* payloadlen);
+// unreliable data too big for the packet is split into MAX_CHUNK fragments, each its own packet.
+// returns false if the unreliable data wasn't sent
 bool netchan_send(netchan_t* state, int dc, const netbuf_t* unreliable);
 bool netchan_queue(netchan_t* state, const netbuf_t* msg);
+// frees queued data and clears the channel for a new connection
+void netchan_reset(netchan_t* state);
+// whether the peer has said it got outgoing packet seq. false once seq is NETSTATS_TIMES old
+bool netchan_acked(const netchan_t* state, int32_t seq);
 
-#endif
\ No newline at end of file
+#endif
@@ -5,115 +5,154 @@
 #include <string.h>
 
 #define NETBUF_MINSIZE 32
+// big enough for a full snapshot split into the most fragments a channel will send
+#define NETSCRATCH_SIZE (512 * 1024)
 
 bool netpacketfull;
 
-static void netbuf_resize(netbuf_t* buf)
-{
-    buf->cap *= 2;
-    buf->data = realloc(buf->data, buf->cap);
-}
+static uint8_t netscratch[NETSCRATCH_SIZE];
+static int netscratchused = 0;
 
 void netbuf_init(netbuf_t* buf)
 {
     buf->data = malloc(NETBUF_MINSIZE);
     buf->len = 0;
     buf->cap = NETBUF_MINSIZE;
+    buf->fixed = buf->overflow = false;
+}
+
+void netbuf_initstatic(netbuf_t* buf, void* data, int cap)
+{
+    buf->data = data;
+    buf->len = 0;
+    buf->cap = cap;
+    buf->fixed = true;
+    buf->overflow = false;
+}
+
+void netbuf_initscratch(netbuf_t* buf, int cap)
+{
+    if(netscratchused + cap > NETSCRATCH_SIZE)
+    {
+        netbuf_init(buf);
+        return;
+    }
+
+    netbuf_initstatic(buf, netscratch + netscratchused, cap);
+    netscratchused += cap;
+}
+
+void netbuf_resetscratch(void)
+{
+    netscratchused = 0;
+}
+
+bool netbuf_reserve(netbuf_t* buf, int len)
+{
+    if(buf->len + len <= buf->cap)
+        return true;
+
+    if(buf->fixed)
+    {
+        buf->overflow = true;
+        return false;
+    }
+
+    if(!buf->cap)
+        buf->cap = NETBUF_MINSIZE;
+    while(buf->len + len > buf->cap)
+        buf->cap *= 2;
+    buf->data = realloc(buf->data, buf->cap);
+
+    return true;
+}
+
+bool netbuf_fits(const netbuf_t* buf, int len)
+{
+    return !buf->fixed || buf->len + len <= buf->cap;
 }
 
 void netbuf_writeu8(netbuf_t* buf, uint8_t val)
 {
-    while(buf->len + sizeof(uint8_t) >= buf->cap)
-        netbuf_resize(buf);
-    
-    *(uint8_t*) (buf->data + buf->len) = val;
-    buf->len += sizeof(uint8_t);
+    if(!netbuf_reserve(buf, sizeof(uint8_t)))
+        return;
+
+    netbuf_putu8(buf, val);
 }
 
 void netbuf_writei8(netbuf_t* buf, int8_t val)
 {
-    while(buf->len + sizeof(int8_t) >= buf->cap)
-        netbuf_resize(buf);
-    
-    *(int8_t*) (buf->data + buf->len) = val;
-    buf->len += sizeof(int8_t);
+    if(!netbuf_reserve(buf, sizeof(int8_t)))
+        return;
+
+    netbuf_putu8(buf, val);
 }
 
 void netbuf_writeu16(netbuf_t* buf, uint16_t val)
 {
-    while(buf->len + sizeof(uint16_t) >= buf->cap)
-        netbuf_resize(buf);
-    
-    *(uint16_t*) (buf->data + buf->len) = htons(val);
-    buf->len += sizeof(uint16_t);
+    if(!netbuf_reserve(buf, sizeof(uint16_t)))
+        return;
+
+    netbuf_putu16(buf, val);
 }
 
 void netbuf_writei16(netbuf_t* buf, int16_t val)
 {
-    while(buf->len + sizeof(int16_t) >= buf->cap)
-        netbuf_resize(buf);
-    
-    *(int16_t*) (buf->data + buf->len) = htons(val);
-    buf->len += sizeof(int16_t);
+    if(!netbuf_reserve(buf, sizeof(int16_t)))
+        return;
+
+    netbuf_putu16(buf, val);
 }
 
 void netbuf_writeu32(netbuf_t* buf, uint32_t val)
 {
-    while(buf->len + sizeof(uint32_t) >= buf->cap)
-        netbuf_resize(buf);
-    
-    *(uint32_t*) (buf->data + buf->len) = htonl(val);
-    buf->len += sizeof(uint32_t);
+    if(!netbuf_reserve(buf, sizeof(uint32_t)))
+        return;
+
+    netbuf_putu32(buf, val);
 }
 
 void netbuf_writei32(netbuf_t* buf, int32_t val)
 {
-    while(buf->len + sizeof(int32_t) >= buf->cap)
-        netbuf_resize(buf);
-    
-    *(int32_t*) (buf->data + buf->len) = htonl(val);
-    buf->len += sizeof(int32_t);
+    if(!netbuf_reserve(buf, sizeof(int32_t)))
+        return;
+
+    netbuf_putu32(buf, val);
 }
 
 void netbuf_writeu64(netbuf_t* buf, uint64_t val)
 {
-    while(buf->len + sizeof(uint64_t) >= buf->cap)
-        netbuf_resize(buf);
-    
-    *(uint64_t*) (buf->data + buf->len) = htonll(val);
-    buf->len += sizeof(uint64_t);
+    if(!netbuf_reserve(buf, sizeof(uint64_t)))
+        return;
+
+    netbuf_putu32(buf, val >> 32);
+    netbuf_putu32(buf, val);
 }
 
 void netbuf_writei64(netbuf_t* buf, int64_t val)
 {
-    while(buf->len + sizeof(int64_t) >= buf->cap)
-        netbuf_resize(buf);
-    
-    *(int64_t*) (buf->data + buf->len) = htonll(val);
-    buf->len += sizeof(int64_t);
+    netbuf_writeu64(buf, val);
 }
 
 void netbuf_writefloat(netbuf_t* buf, float val)
 {
-    while(buf->len + sizeof(float) >= buf->cap)
-        netbuf_resize(buf);
-    
-    *(int32_t*) (buf->data + buf->len) = htonl(*(int32_t*)&val);
-    buf->len += sizeof(float);
+    if(!netbuf_reserve(buf, sizeof(float)))
+        return;
+
+    netbuf_putfloat(buf, val);
 }
 
-void netbuf_writedata(netbuf_t* buf, void* data, int len)
+void netbuf_writedata(netbuf_t* buf, const void* data, int len)
 {
-    while(buf->len + len >= buf->cap)
-        netbuf_resize(buf);
+    if(!netbuf_reserve(buf, len))
+        return;
 
-    memcpy(buf->data + buf->len, data, len);
-    buf->len += len;
+    netbuf_putdata(buf, data, len);
 }
 
 void netbuf_free(netbuf_t* buf)
 {
-    if(buf->data)
+    if(buf->data && !buf->fixed)
         free(buf->data);
 
     buf->data = NULL;
@@ -5,6 +5,12 @@
 
 #define USERNAME_LEN 16
 
+// snapshots both sides keep as possible delta bases. at one snapshot a tic this covers
+// a bit under a second of round trip, past that the server spaces snapshots out to match
+#define GAMESTATE_WINDOW 32
+// every input packet repeats up to this many of the newest commands the server hasn't run
+#define CMD_REDUNDANCY 4
+
 #define FIELD_EXISTS 0x0001 // uint8_t
 #define FIELD_X 0x0002 // float
 #define FIELD_Y 0x0004 // float
@@ -35,6 +41,7 @@
 #define PFIELD_CURWPN 0x0200 // uint8_t (weapon_e)
 #define PFIELD_PENDWPN 0x0400 // uint8_t (weapon_e)
 #define PFIELD_WPNTIME 0x0800 // float
+#define PFIELD_RNG 0x1000 // uint8_t
 
 #define SND_HASEDICT 0x01 // uint16_t edict
 #define SND_HASPOS   0x02 // float x, float y
@@ -51,14 +58,16 @@ typedef enum
     SVC_SERVERFULL, //
     SVC_HANDSHAKE, // int32_t clientid, int16_t nwads, char[13][nwads] wadnames (in order)
     SVC_CHANGELEVEL, // int8_t episode, int8_t map
-    SVC_ENTDELTAS, // n times (uint16_t edict, uint16_t fields, <fields>) 0xFFFF, n times (uint16_t sector, uint8_t fields, <fields>) 0xFFFF
-    CSV_INPUT, // uint8_t flags, uint32_t (angle_t) angle, float frametime
+    SVC_ENTDELTAS, // int32_t tic, n times (uint16_t edict, uint16_t fields, <fields>) 0xFFFF, n times (uint16_t sector, uint8_t fields, <fields>) 0xFFFF
+    CSV_INPUT, // int32_t seq, uint8_t n, n times (uint8_t age, uint8_t flags, uint32_t (angle_t) angle, uint8_t switchwpn, float frametime, int32_t viewms), oldest first. a command's sequence is seq - age
     CSV_USE, //
     SVC_PLAYERDELTAS, // uint16_t fields, <fields>
-    SVC_SOUND, // uint8_t sfxid, uint8_t flags, [uint16_t edict] OR [float x, float y]
+    SVC_SOUNDEVENTS, // uint8_t n, n times (int32_t seq, uint8_t sfxid, uint8_t flags, [uint16_t edict] OR [float x, float y])
     SVC_SETPLAYEDICT, // int32_t newedict
     CSV_RESPAWN, // 
     SVC_PICKUP, // (use purely for sound and fade, doesn't say what you got)
+    SVC_SNAPSHOT, // int32_t deltaseq, the snapshot the deltas after this are from. 0 for the level as loaded. int32_t cmdseq, the newest command run
+    NUM_PACKETS,
 } packet_e;
 
 typedef struct
@@ -5,6 +5,7 @@
 #include <string.h>
 
 #include "move.h"
+#include "rand.h"
 #include "snd.h"
 #include "special.h"
 #include "level.h"
@@ -137,174 +138,192 @@ void player_initinfo(playerinfo_t* info)
     *info = defaultplayerinfo;
 }
 
-static player_t *curplayer;
-
-static bool player_pickupwpn(weapon_e type)
+static bool player_pickupwpn(player_t* player, weapon_e type)
 {
     bool gavewpn, gaveammo;
 
     gavewpn = gaveammo = false;
 
     if(wpndefs[type].ammo != AMMO_NONE
-    && curplayer->info.ammo[wpndefs[type].ammo] < player_maxammo(curplayer, wpndefs[type].ammo))
+    && player->info.ammo[wpndefs[type].ammo] < player_maxammo(player, wpndefs[type].ammo))
     {
         gaveammo = true;
         switch(wpndefs[type].ammo)
         {
         case AMMO_BUL:
-            curplayer->info.ammo[AMMO_BUL] = MIN(curplayer->info.ammo[AMMO_BUL] + 20, player_maxammo(curplayer, AMMO_BUL));
+            player->info.ammo[AMMO_BUL] = MIN(player->info.ammo[AMMO_BUL] + 20, player_maxammo(player, AMMO_BUL));
             break;
         case AMMO_SHEL:
-            curplayer->info.ammo[AMMO_SHEL] = MIN(curplayer->info.ammo[AMMO_SHEL] + 8, player_maxammo(curplayer, AMMO_SHEL));
+            player->info.ammo[AMMO_SHEL] = MIN(player->info.ammo[AMMO_SHEL] + 8, player_maxammo(player, AMMO_SHEL));
             break;
         case AMMO_ROCK:
-            curplayer->info.ammo[AMMO_ROCK] = MIN(curplayer->info.ammo[AMMO_ROCK] + 2, player_maxammo(curplayer, AMMO_ROCK));
+            player->info.ammo[AMMO_ROCK] = MIN(player->info.ammo[AMMO_ROCK] + 2, player_maxammo(player, AMMO_ROCK));
             break;
         case AMMO_CELL:
-            curplayer->info.ammo[AMMO_CELL] = MIN(curplayer->info.ammo[AMMO_CELL] + 60, player_maxammo(curplayer, AMMO_CELL));
+            player->info.ammo[AMMO_CELL] = MIN(player->info.ammo[AMMO_CELL] + 60, player_maxammo(player, AMMO_CELL));
             break;
         default:
             break;
         }
     }
 
-    if(!(curplayer->info.weapons & (1 << type)))
+    if(!(player->info.weapons & (1 << type)))
     {
         gavewpn = true;
-        curplayer->info.weapons |= 1 << type;
-        curplayer->info.weapon.pend = type;
+        player->info.weapons |= 1 << type;
+        player->info.weapon.pend = type;
     }
 
     return gaveammo || gavewpn;
 }
 
-bool player_walkovercol(float x1, float y1, float x2, float y2, linedef_t* line, float t)
+bool player_walkovercol(float x1, float y1, float x2, float y2, linedef_t* line, float t, void* ctx)
 {
+    player_t *player;
+
+    player = ctx;
+
     if(!line->special || !line->tag)
         return false;
 
-    level_trigger(curplayer->mobj, line->tag, line->special);
+    // a dumb player only notes it, the server triggers the line
+    player->paths |= PATH_TRIGGER;
+    if(player->dumb)
+        return false;
+
+    level_trigger(player->mobj, line->tag, line->special);
 
     return false;
 }
 
-void player_pickupcol(object_t* obj)
+void player_pickupcol(object_t* obj, void* ctx)
 {
+    player_t *player;
     sound_e sound;
 
-    if(curplayer->mobj->info.z > obj->info.z + obj->info.height)
+    player = ctx;
+
+    if(player->mobj->info.z > obj->info.z + obj->info.height)
         return;
 
-    if(curplayer->mobj->info.z + curplayer->mobj->info.height < obj->info.z)
+    if(player->mobj->info.z + player->mobj->info.height < obj->info.z)
         return;
 
+    // a dumb player only notes touching it, whether it's taken is up to the server
+    if(player->dumb)
+    {
+        if(obj->info.flags & MF_SPECIAL)
+            player->paths |= PATH_PICKUP;
+        return;
+    }
+
     sound = sfx_itemup;
     switch(states[obj->info.state].sprite)
     {
     case SPR_ARM1:
-        if(curplayer->info.armor >= 100)
+        if(player->info.armor >= 100)
             return;
-        curplayer->info.flags &= ~PFLAG_BLUARMOR;
-        curplayer->info.armor = 100;
+        player->info.flags &= ~PFLAG_BLUARMOR;
+        player->info.armor = 100;
         break;
     case SPR_ARM2:
-        if(curplayer->info.armor >= 200)
+        if(player->info.armor >= 200)
             return;
-        curplayer->info.flags |= PFLAG_BLUARMOR;
-        curplayer->info.armor = 200;
+        player->info.flags |= PFLAG_BLUARMOR;
+        player->info.armor = 200;
         break;
     case SPR_BON1:
-        curplayer->mobj->info.health++;
-        if(curplayer->mobj->info.health > 200)
-            curplayer->mobj->info.health = 200;
+        player->mobj->info.health++;
+        if(player->mobj->info.health > 200)
+            player->mobj->info.health = 200;
         break;
     case SPR_BON2:
-        curplayer->info.armor++;
-        if(curplayer->info.armor > 200)
-            curplayer->info.armor = 200;
+        player->info.armor++;
+        if(player->info.armor > 200)
+            player->info.armor = 200;
         break;
     case SPR_STIM:
-        if(curplayer->mobj->info.health >= 100)
+        if(player->mobj->info.health >= 100)
             return;
-        curplayer->mobj->info.health += 10;
-        if(curplayer->mobj->info.health > 100)
-            curplayer->mobj->info.health = 100;
+        player->mobj->info.health += 10;
+        if(player->mobj->info.health > 100)
+            player->mobj->info.health = 100;
         break;
     case SPR_MEDI:
-        if(curplayer->mobj->info.health >= 100)
+        if(player->mobj->info.health >= 100)
             return;
-        curplayer->mobj->info.health += 25;
-        if(curplayer->mobj->info.health > 100)
-            curplayer->mobj->info.health = 100;
+        player->mobj->info.health += 25;
+        if(player->mobj->info.health > 100)
+            player->mobj->info.health = 100;
         break;
     case SPR_CLIP:
-        if(curplayer->info.ammo[AMMO_BUL] >= player_maxammo(curplayer, AMMO_BUL))
+        if(player->info.ammo[AMMO_BUL] >= player_maxammo(player, AMMO_BUL))
             return;
-        curplayer->info.ammo[AMMO_BUL] += 10;
-        if(curplayer->info.ammo[AMMO_BUL] > player_maxammo(curplayer, AMMO_BUL))
-            curplayer->info.ammo[AMMO_BUL] = player_maxammo(curplayer, AMMO_BUL);
+        player->info.ammo[AMMO_BUL] += 10;
+        if(player->info.ammo[AMMO_BUL] > player_maxammo(player, AMMO_BUL))
+            player->info.ammo[AMMO_BUL] = player_maxammo(player, AMMO_BUL);
         break;
     case SPR_AMMO:
-        if(curplayer->info.ammo[AMMO_BUL] >= player_maxammo(curplayer, AMMO_BUL))
+        if(player->info.ammo[AMMO_BUL] >= player_maxammo(player, AMMO_BUL))
             return;
-        curplayer->info.ammo[AMMO_BUL] += 50;
-        if(curplayer->info.ammo[AMMO_BUL] > player_maxammo(curplayer, AMMO_BUL))
-            curplayer->info.ammo[AMMO_BUL] = player_maxammo(curplayer, AMMO_BUL);
+        player->info.ammo[AMMO_BUL] += 50;
+        if(player->info.ammo[AMMO_BUL] > player_maxammo(player, AMMO_BUL))
+            player->info.ammo[AMMO_BUL] = player_maxammo(player, AMMO_BUL);
         break;
     case SPR_SHEL:
-        if(curplayer->info.ammo[AMMO_SHEL] >= player_maxammo(curplayer, AMMO_SHEL))
+        if(player->info.ammo[AMMO_SHEL] >= player_maxammo(player, AMMO_SHEL))
             return;
-        curplayer->info.ammo[AMMO_SHEL] += 4;
-        if(curplayer->info.ammo[AMMO_SHEL] > player_maxammo(curplayer, AMMO_SHEL))
-            curplayer->info.ammo[AMMO_SHEL] = player_maxammo(curplayer, AMMO_SHEL);
+        player->info.ammo[AMMO_SHEL] += 4;
+        if(player->info.ammo[AMMO_SHEL] > player_maxammo(player, AMMO_SHEL))
+            player->info.ammo[AMMO_SHEL] = player_maxammo(player, AMMO_SHEL);
         break;
     case SPR_SBOX:
-        if(curplayer->info.ammo[AMMO_SHEL] >= player_maxammo(curplayer, AMMO_SHEL))
+        if(player->info.ammo[AMMO_SHEL] >= player_maxammo(player, AMMO_SHEL))
             return;
-        curplayer->info.ammo[AMMO_SHEL] += 20;
-        if(curplayer->info.ammo[AMMO_SHEL] > player_maxammo(curplayer, AMMO_SHEL))
-            curplayer->info.ammo[AMMO_SHEL] = player_maxammo(curplayer, AMMO_SHEL);
+        player->info.ammo[AMMO_SHEL] += 20;
+        if(player->info.ammo[AMMO_SHEL] > player_maxammo(player, AMMO_SHEL))
+            player->info.ammo[AMMO_SHEL] = player_maxammo(player, AMMO_SHEL);
         break;
     case SPR_ROCK:
-        if(curplayer->info.ammo[AMMO_ROCK] >= player_maxammo(curplayer, AMMO_ROCK))
+        if(player->info.ammo[AMMO_ROCK] >= player_maxammo(player, AMMO_ROCK))
             return;
-        curplayer->info.ammo[AMMO_ROCK] += 1;
-        if(curplayer->info.ammo[AMMO_ROCK] > player_maxammo(curplayer, AMMO_ROCK))
-            curplayer->info.ammo[AMMO_ROCK] = player_maxammo(curplayer, AMMO_ROCK);
+        player->info.ammo[AMMO_ROCK] += 1;
+        if(player->info.ammo[AMMO_ROCK] > player_maxammo(player, AMMO_ROCK))
+            player->info.ammo[AMMO_ROCK] = player_maxammo(player, AMMO_ROCK);
         break;
     case SPR_BROK:
-        if(curplayer->info.ammo[AMMO_ROCK] >= player_maxammo(curplayer, AMMO_ROCK))
+        if(player->info.ammo[AMMO_ROCK] >= player_maxammo(player, AMMO_ROCK))
             return;
-        curplayer->info.ammo[AMMO_ROCK] += 5;
-        if(curplayer->info.ammo[AMMO_ROCK] > player_maxammo(curplayer, AMMO_ROCK))
-            curplayer->info.ammo[AMMO_ROCK] = player_maxammo(curplayer, AMMO_ROCK);
+        player->info.ammo[AMMO_ROCK] += 5;
+        if(player->info.ammo[AMMO_ROCK] > player_maxammo(player, AMMO_ROCK))
+            player->info.ammo[AMMO_ROCK] = player_maxammo(player, AMMO_ROCK);
         break;
     case SPR_CELL:
-        if(curplayer->info.ammo[AMMO_CELL] >= player_maxammo(curplayer, AMMO_CELL))
+        if(player->info.ammo[AMMO_CELL] >= player_maxammo(player, AMMO_CELL))
             return;
-        curplayer->info.ammo[AMMO_CELL] += 20;
-        if(curplayer->info.ammo[AMMO_CELL] > player_maxammo(curplayer, AMMO_CELL))
-            curplayer->info.ammo[AMMO_CELL] = player_maxammo(curplayer, AMMO_CELL);
+        player->info.ammo[AMMO_CELL] += 20;
+        if(player->info.ammo[AMMO_CELL] > player_maxammo(player, AMMO_CELL))
+            player->info.ammo[AMMO_CELL] = player_maxammo(player, AMMO_CELL);
         break;
     case SPR_CELP:
-        if(curplayer->info.ammo[AMMO_CELL] >= player_maxammo(curplayer, AMMO_CELL))
+        if(player->info.ammo[AMMO_CELL] >= player_maxammo(player, AMMO_CELL))
             return;
-        curplayer->info.ammo[AMMO_CELL] += 100;
-        if(curplayer->info.ammo[AMMO_CELL] > player_maxammo(curplayer, AMMO_CELL))
-            curplayer->info.ammo[AMMO_CELL] = player_maxammo(curplayer, AMMO_CELL);
+        player->info.ammo[AMMO_CELL] += 100;
+        if(player->info.ammo[AMMO_CELL] > player_maxammo(player, AMMO_CELL))
+            player->info.ammo[AMMO_CELL] = player_maxammo(player, AMMO_CELL);
         break;
     case SPR_SHOT:
-        if(!player_pickupwpn(WEAPON_SHOT))
+        if(!player_pickupwpn(player, WEAPON_SHOT))
             return;
         sound = sfx_wpnup;
         break;
     case SPR_MGUN:
-        if(!player_pickupwpn(WEAPON_CHAIN))
+        if(!player_pickupwpn(player, WEAPON_CHAIN))
             return;
         sound = sfx_wpnup;
         break;
     case SPR_LAUN:
-        if(!player_pickupwpn(WEAPON_ROCKET))
+        if(!player_pickupwpn(player, WEAPON_ROCKET))
             return;
         sound = sfx_wpnup;
         break;
@@ -313,8 +332,9 @@ void player_pickupcol(object_t* obj)
     }
 
     level_removemobj(obj);
-    curplayer->pickupcnt += 6;
-    snd_queueedict(sound, curplayer->mobj - mobjs);
+    player->paths |= PATH_PICKUP;
+    player->pickupcnt += 6;
+    snd_queueedict(sound, player->mobj - mobjs);
 }
 
 void player_docmd(player_t* play, const playercmd_t* cmd)
@@ -327,11 +347,12 @@ void player_docmd(player_t* play, const playercmd_t* cmd)
     float floorz;
     float x, y;
 
+    play->paths = 0;
+
     if(play->mobj && play->mobj->info.health)
         play->mobj->info.angle = cmd->angle;
 
-    level_mobjheights(play->mobj);
-    floorz = mobjfloorheight;
+    level_mobjheights(play->mobj, &floorz, NULL);
     if(play->mobj->info.z <= floorz && play->mobj && play->mobj->info.health)
     {
         sinangle = ANGSIN(play->mobj->info.angle);
@@ -353,18 +374,21 @@ void player_docmd(player_t* play, const playercmd_t* cmd)
         play->mobj->info.xvel += thrustx * cmd->frametime;
         play->mobj->info.yvel += thrusty * cmd->frametime;
     }
+    else
+        play->paths |= PATH_AIR;
 
-    if(play->mobj && !play->dumb && play->mobj->info.health)
+    if(play->mobj && play->mobj->info.health)
     {
         x = play->mobj->info.x + play->mobj->info.xvel * cmd->frametime;
         y = play->mobj->info.y + play->mobj->info.yvel * cmd->frametime;
 
-        curplayer = play;
-        level_thingcollisions(x, y, mobjinfo[MT_PLAYER].radius, NULL, player_pickupcol);
-        level_traverseline(play->mobj->info.x, play->mobj->info.y, x, y, true, player_walkovercol, NULL);
+        level_thingcollisions(x, y, mobjinfo[MT_PLAYER].radius, NULL, player_pickupcol, play);
+        level_traverseline(play->mobj->info.x, play->mobj->info.y, x, y, true, player_walkovercol, NULL, play);
     }
     
     move(play->mobj, cmd->frametime);
+    if(level_mobjonmover(play->mobj))
+        play->paths |= PATH_MOVER;
 
     curwpnplayer = play;
     weapon_docmd(&play->info.weapon, cmd->flags, cmd->switchwpn);
@@ -425,13 +449,14 @@ float player_getviewheight(object_t* playobj, float time, float frametime)
     return bob + pviewheight + playobj->info.z;
 }
 
-object_t *usemobj;
-
-static bool usecol(float x1, float y1, float x2, float y2, linedef_t* line, float t)
+static bool usecol(float x1, float y1, float x2, float y2, linedef_t* line, float t, void* ctx)
 {
+    object_t *usemobj;
     float top, bottom;
     int side;
 
+    usemobj = ctx;
+
     side = level_lineside(line, x1, y1);
 
     if(!side && line->special)
@@ -493,6 +518,11 @@ int player_maxammo(player_t* player, ammo_e ammo)
     }
 }
 
+uint8_t player_rand(player_t* player)
+{
+    return prandstream(&player->info.rngindex);
+}
+
 void player_use(player_t* player)
 {
     float x1, y1, x2, y2, dx, dy;
@@ -506,7 +536,5 @@ void player_use(player_t* player)
     x2 = x1 + dx;
     y2 = y1 + dy;
 
-    usemobj = player->mobj;
-
-    level_traverseline(x1, y1, x2, y2, false, usecol, NULL);
+    level_traverseline(x1, y1, x2, y2, false, usecol, NULL, player->mobj);
 }
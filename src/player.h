@@ -12,6 +12,15 @@
 #define CMD_RIGHT 0x08
 #define CMD_FIRE 0x10
 
+// code paths a command went through, so mispredictions can be traced to them
+#define PATH_SLIDE 0x01 // slid along a line
+#define PATH_SLIDEMOBJ 0x02 // slid along a mobj
+#define PATH_PICKUP 0x04
+#define PATH_TRIGGER 0x08 // walked over a line special
+#define PATH_AIR 0x10 // no thrust, off the ground
+#define PATH_MOVER 0x20 // touching a sector a door or lift is moving
+#define NUM_PATHS 6
+
 #define PFLAG_BLUARMOR 0x01
 #define PFLAG_BACKPACK 0x02
 #define PFLAG_BLUCARD 0x04
@@ -29,6 +38,7 @@ typedef struct
     int ammo[NUM_AMMO];
     int frags;
     wpnst_t weapon;
+    uint8_t rngindex; // the player's own random sequence, only its commands draw from it
 } playerinfo_t;
 
 typedef struct
@@ -37,6 +47,7 @@ typedef struct
     angle_t angle;
     uint8_t switchwpn; // WEAPON_NONE if no switch
     float frametime;
+    int32_t viewms; // server time the client was showing everything else at, for lag compensation
 } playercmd_t;
 
 typedef struct player_s
@@ -46,6 +57,7 @@ typedef struct player_s
     thinker_t *thinker;
     playercmd_t lastcmd;
     float pickupcnt;
+    uint8_t paths; // PATH_XX of the last command
 
     bool dumb; // 'dumb' player, true for client, false for server
 } player_t;
@@ -65,6 +77,8 @@ float player_calcbobamp(object_t* playobj);
 float player_calcheadbob(object_t* playobj, float time);
 float player_getviewheight(object_t* playobj, float time, float frametime);
 int player_maxammo(player_t* player, ammo_e ammo);
+// draws from the player's own sequence, so the draws only depend on the player's commands
+uint8_t player_rand(player_t* player);
 void player_use(player_t* player);
 
 #endif
\ No newline at end of file
@@ -24,8 +24,6 @@ static const uint8_t randoms[256] =
     120, 163, 236, 249
 };
 
-// maybe send this from the server to the client so
-// predicted state of random things is in sync?
 uint8_t prandindex = 0;
 uint8_t mrandindex = 0;
 
@@ -37,4 +35,9 @@ uint8_t prand(void)
 uint8_t mrand(void)
 {
     return randoms[mrandindex++];
+}
+
+uint8_t prandstream(uint8_t* index)
+{
+    return randoms[(*index)++];
 }
\ No newline at end of file
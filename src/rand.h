@@ -5,5 +5,7 @@
 
 uint8_t prand(void);
 uint8_t mrand(void);
+// the same table as a sequence of its own, index is where that sequence is up to
+uint8_t prandstream(uint8_t* index);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,67 @@
+#include "capture.h"
+
+#include <stdio.h>
+
+#include "client.h"
+#include "net.h"
+
+// the file is flushed at most this often, so a killed server loses little
+#define CAPTURE_FLUSHSECS 1.0
+
+static FILE *capfile = NULL;
+static double capstart, lastflush;
+
+static void capture_packet(const netchan_t* state, bool out, const void* data, int len)
+{
+    int i;
+
+    uint8_t header[8];
+    uint32_t ms;
+    double now;
+
+    // channels that aren't a client's are throwaways for reading handshakes,
+    // the handshake is seen again once it's handed to the client's channel
+    for(i=0; i<MAX_CLIENT; i++)
+        if(state == &clients[i].chan)
+            break;
+    if(i >= MAX_CLIENT)
+        return;
+
+    now = net_time();
+    ms = (now - capstart) * 1000;
+
+    header[0] = ms >> 24;
+    header[1] = ms >> 16;
+    header[2] = ms >> 8;
+    header[3] = ms;
+    header[4] = out ? CAPTURE_OUT : 0;
+    header[5] = i;
+    header[6] = len >> 8;
+    header[7] = len;
+    fwrite(header, 1, sizeof(header), capfile);
+    fwrite(data, 1, len, capfile);
+
+    if(now - lastflush >= CAPTURE_FLUSHSECS)
+    {
+        fflush(capfile);
+        lastflush = now;
+    }
+}
+
+bool capture_open(const char* path)
+{
+    if(!(capfile = fopen(path, "wb")))
+    {
+        fprintf(stderr, "capture_open: can't open %s\n", path);
+        return false;
+    }
+
+    fwrite("NCAP", 1, 4, capfile);
+    fputc(CAPTURE_VERSION, capfile);
+
+    capstart = lastflush = net_time();
+    netchan_capture = capture_packet;
+
+    printf("capturing packets to %s\n", path);
+    return true;
+}
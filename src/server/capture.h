@@ -0,0 +1,15 @@
+#ifndef _CAPTURE_H
+#define _CAPTURE_H
+
+#include <stdbool.h>
+
+// starts logging every datagram to and from clients to path, netcap.py reads it back.
+// the file is "NCAP", a version byte, then records of
+// uint32_t ms since the capture began, uint8_t flags (CAPTURE_OUT), uint8_t client,
+// uint16_t len and the datagram. all big endian
+bool capture_open(const char* path);
+
+#define CAPTURE_VERSION 1
+#define CAPTURE_OUT 0x01
+
+#endif
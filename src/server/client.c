@@ -1,6 +1,7 @@
 #include "client.h"
 
 #include <assert.h>
+#include <math.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -15,20 +16,34 @@ int net_recv_disconnect(int *dc_out);
 #include "player.h"
 #include "rand.h"
 #include "snd.h"
+#include "svsnd.h"
 #include "wad.h"
 
+// edict, field flags and every field
+#define ENTDELTA_MAXSIZE (2 + 2 + 1 + 4 * 3 + 4 + 2 * 2 + 4 * 3 + 1 + 2 + 4 + 2)
+// what a single snapshot can be fragmented into
+#define UNRELIABLE_MAXSIZE (MAX_FRAGMENTS * MAX_CHUNK)
+
 gamestate_t dummystate = {};
+static playerinfo_t dummyplaystate = {};
 
 client_t clients[MAX_CLIENT] = {};
 
-static void updategamestate(client_t* cl)
+int snapshotinterval = 1;
+
+// outseq is the last packet of the snapshot, that's the one the client acks once it has all of it.
+// sndcovered is the newest sound event the snapshot took care of
+static void updategamestate(client_t* cl, int32_t sndcovered)
 {
     int i;
 
     int index;
     gamestate_t *gs;
 
-    index = cl->chan.outseq % GAMESTATE_WINDOW;
+    index = cl->nsnapshots++ % GAMESTATE_WINDOW;
+    cl->snapseqs[index] = cl->chan.outseq;
+    cl->snapsettled[index] = false;
+    cl->snaptics[index] = ntics;
     gs = &cl->gamestates[index];
     gs->maxmobj = mobjmax;
     for(i=0; i<=mobjmax; i++)
@@ -40,6 +55,7 @@ static void updategamestate(client_t* cl)
     }
 
     memcpy(&cl->playstates[index], &cl->player.info, sizeof(playerinfo_t));
+    cl->sndseqs[index] = sndcovered;
 }
 
 void allocgamestatesectors(void)
@@ -56,20 +72,34 @@ void allocgamestatesectors(void)
         }
 }
 
-static void addentdeltas(int edict, client_t* cl, netbuf_t* buf)
+// the slot of the newest snapshot the client has acked, -1 if it hasn't got one we still have.
+// the ack bits count too, so a lost ack or an ack of a packet without a snapshot
+// doesn't force a full update. the client keeps at least as many as we do
+static int findbaseline(client_t* cl)
+{
+    int i;
+
+    int best;
+
+    best = -1;
+    for(i=0; i<GAMESTATE_WINDOW; i++)
+    {
+        if(!cl->snapseqs[i] || !netchan_acked(&cl->chan, cl->snapseqs[i]))
+            continue;
+        if(best < 0 || cl->snapseqs[i] > cl->snapseqs[best])
+            best = i;
+    }
+
+    return best;
+}
+
+static void addentdeltas(int edict, gamestate_t* gs, netbuf_t* buf)
 {
     bool spawned;
     int fieldflags;
-    gamestate_t *gs;
     objinfo_t *compare, *info;
 
     info = &mobjs[edict].info;
-
-    if(cl->chan.inack < cl->firstdeltaseq)
-        gs = &dummystate;
-    else
-        gs = &cl->gamestates[cl->chan.inack % GAMESTATE_WINDOW];
-
     compare = &gs->mobjs[edict];
 
     if(!info->exists && !compare->exists)
@@ -111,54 +141,50 @@ static void addentdeltas(int edict, client_t* cl, netbuf_t* buf)
     if(!fieldflags)
         return;
 
-    netbuf_writeu16(buf, edict);
-    netbuf_writeu16(buf, fieldflags);
+    if(!netbuf_reserve(buf, ENTDELTA_MAXSIZE))
+        return;
+
+    netbuf_putu16(buf, edict);
+    netbuf_putu16(buf, fieldflags);
     if(fieldflags & FIELD_EXISTS)
-        netbuf_writeu8(buf, info->exists);
+        netbuf_putu8(buf, info->exists);
     if(fieldflags & FIELD_X)
-        netbuf_writefloat(buf, info->x);
+        netbuf_putfloat(buf, info->x);
     if(fieldflags & FIELD_Y)
-        netbuf_writefloat(buf, info->y);
+        netbuf_putfloat(buf, info->y);
     if(fieldflags & FIELD_Z)
-        netbuf_writefloat(buf, info->z);
+        netbuf_putfloat(buf, info->z);
     if(fieldflags & FIELD_ANGLE)
-        netbuf_writeu32(buf, info->angle);
+        netbuf_putu32(buf, info->angle);
     if(fieldflags & FIELD_STATE)
-        netbuf_writei16(buf, info->state);
+        netbuf_putu16(buf, info->state);
     if(fieldflags & FIELD_TYPE)
-        netbuf_writei16(buf, info->type);
+        netbuf_putu16(buf, info->type);
     if(fieldflags & FIELD_XVEL)
-        netbuf_writefloat(buf, info->xvel);
+        netbuf_putfloat(buf, info->xvel);
     if(fieldflags & FIELD_YVEL)
-        netbuf_writefloat(buf, info->yvel);
+        netbuf_putfloat(buf, info->yvel);
     if(fieldflags & FIELD_ZVEL)
-        netbuf_writefloat(buf, info->zvel);
+        netbuf_putfloat(buf, info->zvel);
     if(fieldflags & FIELD_COLOR)
-        netbuf_writeu8(buf, info->color);
+        netbuf_putu8(buf, info->color);
     if(fieldflags & FIELD_HEALTH)
-        netbuf_writei16(buf, info->health);
+        netbuf_putu16(buf, info->health);
     if(fieldflags & FIELD_FLAGS)
-        netbuf_writei32(buf, info->flags);
+        netbuf_putu32(buf, info->flags);
     if(fieldflags & FIELD_HEIGHT)
-        netbuf_writei16(buf, info->height);
+        netbuf_putu16(buf, info->height);
 }
 
-static void addsectordeltas(int sectornum, client_t* cl, netbuf_t* buf)
+static void addsectordeltas(int sectornum, gamestate_t* gs, netbuf_t* buf)
 {
     int fieldflags;
-    bool firstsend;
-    gamestate_t *gs;
     sectorinfo_t *compare;
     sectorinfo_t info;
 
     info.floorheight = sectors[sectornum].floorheight;
     info.ceilheight = sectors[sectornum].ceilheight;
 
-    if(cl->chan.inack < cl->firstdeltaseq)
-        gs = &dummystate;
-    else
-        gs = &cl->gamestates[cl->chan.inack % GAMESTATE_WINDOW];
-
     compare = &gs->sectorinfos[sectornum];
 
     fieldflags = 0;
@@ -170,25 +196,24 @@ static void addsectordeltas(int sectornum, client_t* cl, netbuf_t* buf)
     if(!fieldflags)
         return;
 
-    netbuf_writeu16(buf, sectornum);
-    netbuf_writeu8(buf, fieldflags);
+    if(!netbuf_reserve(buf, 2 + 1 + 4 + 4))
+        return;
+
+    netbuf_putu16(buf, sectornum);
+    netbuf_putu8(buf, fieldflags);
     if(fieldflags & SFIELD_FLOOR)
-        netbuf_writefloat(buf, info.floorheight);
+        netbuf_putfloat(buf, info.floorheight);
     if(fieldflags & SFIELD_CEIL)
-        netbuf_writefloat(buf, info.ceilheight);
+        netbuf_putfloat(buf, info.ceilheight);
 }
 
-static void addplaydeltas(client_t* cl, netbuf_t* buf)
+static void addplaydeltas(client_t* cl, playerinfo_t* compare, netbuf_t* buf)
 {
     int fields;
-    playerinfo_t *compare, *info;
+    playerinfo_t *info;
 
     info = &cl->player.info;
-    if(cl->chan.inack < cl->firstdeltaseq)
-        compare = &dummystate;
-    else
-        compare = &cl->playstates[cl->chan.inack % GAMESTATE_WINDOW];
-    
+
     fields = 0;
     if(compare->flags != info->flags)
         fields |= PFIELD_FLAGS;
@@ -214,6 +239,8 @@ static void addplaydeltas(client_t* cl, netbuf_t* buf)
         fields |= PFIELD_WPNST;
     if(compare->weapon.time != info->weapon.time)
         fields |= PFIELD_WPNTIME;
+    if(compare->rngindex != info->rngindex)
+        fields |= PFIELD_RNG;
     
     if(!fields)
         return;
@@ -244,31 +271,67 @@ static void addplaydeltas(client_t* cl, netbuf_t* buf)
         netbuf_writei16(buf, info->weapon.state);
     if(fields & PFIELD_WPNTIME)
         netbuf_writefloat(buf, info->weapon.time);
+    if(fields & PFIELD_RNG)
+        netbuf_writeu8(buf, info->rngindex);
 }
 
-static void buildunreliable(client_t* cl, netbuf_t* buf)
+// returns the newest sound event the snapshot covers
+static int32_t buildunreliable(client_t* cl, netbuf_t* buf)
 {
     int i;
 
-    if(cl->state == CLSTATE_CONNECTED)
+    int base, start;
+    gamestate_t *gs;
+    playerinfo_t *playstate;
+    int32_t sndcovered;
+
+    if(cl->state != CLSTATE_CONNECTED)
+        return sndseq;
+
+    // deltas are from the newest snapshot the client is known to have,
+    // which may be several snapshots behind the ones still in flight
+    base = findbaseline(cl);
+    if(base < 0)
+    {
+        gs = &dummystate;
+        playstate = &dummyplaystate;
+    }
+    else
     {
-        addplaydeltas(cl, buf);
+        gs = &cl->gamestates[base];
+        playstate = &cl->playstates[base];
+        cl->sndacked = MAX(cl->sndacked, cl->sndseqs[base]);
+    }
+
+    netbuf_writeu8(buf, SVC_SNAPSHOT);
+    netbuf_writei32(buf, base < 0 ? 0 : cl->snapseqs[base]);
+    netbuf_writei32(buf, cl->cmdrun);
+    cl->bytesout[SVC_SNAPSHOT] += buf->len;
 
-        netbuf_writeu8(buf, SVC_ENTDELTAS);
+    start = buf->len;
+    addplaydeltas(cl, playstate, buf);
+    cl->bytesout[SVC_PLAYERDELTAS] += buf->len - start;
 
-        for(i=0; i<=mobjmax; i++)
-            addentdeltas(i, cl, buf);
+    start = buf->len;
+    netbuf_writeu8(buf, SVC_ENTDELTAS);
+    netbuf_writei32(buf, ntics);
 
-        netbuf_writeu16(buf, 0xFFFF);
+    for(i=0; i<=mobjmax; i++)
+        addentdeltas(i, gs, buf);
 
-        for(i=0; i<nsectors; i++)
-            addsectordeltas(i, cl, buf);
+    netbuf_writeu16(buf, 0xFFFF);
 
-        netbuf_writeu16(buf, 0xFFFF);
+    for(i=0; i<nsectors; i++)
+        addsectordeltas(i, gs, buf);
 
-        if(cl->firstdeltaseq == INT32_MAX)
-            cl->firstdeltaseq = cl->chan.outseq + 1;
-    }
+    netbuf_writeu16(buf, 0xFFFF);
+    cl->bytesout[SVC_ENTDELTAS] += buf->len - start;
+
+    start = buf->len;
+    sndcovered = snd_writeevents(cl, buf);
+    cl->bytesout[SVC_SOUNDEVENTS] += buf->len - start;
+
+    return sndcovered;
 }
 
 void disconnectclient(int i)
@@ -285,6 +348,7 @@ void disconnectclient(int i)
         memset(&cl->player.mobj->info, 0, sizeof(objinfo_t));
     }
 
+    netchan_reset(&cl->chan);
     cl->state = CLSTATE_DC;
     printf("client %d (%s) disconnected\n", i, cl->username);
 }
@@ -295,40 +359,53 @@ void sendtoclients(void)
 
     netbuf_t unreliable;
     netbuf_t reliable;
+    uint8_t reliabledata[MAX_CHUNK];
+    int32_t sndcovered;
+
+    // one snapshot is built at a time, so the same scratch space does for every client
+    netbuf_resetscratch();
+    netbuf_initscratch(&unreliable, UNRELIABLE_MAXSIZE);
 
     for(i=0; i<MAX_CLIENT; i++)
     {
         if(clients[i].state == CLSTATE_DC)
             continue;
-        
-        if(clients[i].chan.outseq > clients[i].chan.lastseen)
+
+        // snapshots go out on the client's own schedule, whether or not the last ones have been acked
+        if(!rate_update(&clients[i]))
             continue;
-        clients[i].chan.outseq = clients[i].chan.lastseen;
 
         if(clients[i].player.pickupcnt != 0)
         {
-            netbuf_init(&reliable);
+            netbuf_initstatic(&reliable, reliabledata, sizeof(reliabledata));
             while(clients[i].player.pickupcnt > 0)
             {
                 netbuf_writeu8(&reliable, SVC_PICKUP);
                 clients[i].player.pickupcnt -= 6;
             }
             clients[i].player.pickupcnt = 0;
+            clients[i].bytesout[SVC_PICKUP] += reliable.len;
             netchan_queue(&clients[i].chan, &reliable);
-            netbuf_free(&reliable);
         }
 
-        netbuf_init(&unreliable);
-        buildunreliable(&clients[i], &unreliable);
+        unreliable.len = 0;
+        unreliable.overflow = false;
+        sndcovered = buildunreliable(&clients[i], &unreliable);
         if(netchan_send(&clients[i].chan, clients[i].dc, &unreliable))
-            updategamestate(&clients[i]);
-        netbuf_free(&unreliable);
+        {
+            updategamestate(&clients[i], sndcovered);
+            clients[i].snapbytes[(clients[i].nsnapshots - 1) % GAMESTATE_WINDOW] = unreliable.len;
+            rate_sent(&clients[i], unreliable.len);
+        }
     }
+
+    netbuf_free(&unreliable);
 }
 
 void* recvrespawn(client_t* cl, void* buf, void* curpos, int len)
 {
     netbuf_t netbuf;
+    uint8_t data[8];
 
     if(!cl->player.mobj)
         return curpos;
@@ -337,11 +414,11 @@ void* recvrespawn(client_t* cl, void* buf, void* curpos, int len)
 
     spawnplayer(cl);
 
-    netbuf_init(&netbuf);
+    netbuf_initstatic(&netbuf, data, sizeof(data));
     netbuf_writeu8(&netbuf, SVC_SETPLAYEDICT);
     netbuf_writei32(&netbuf, (int) (cl->player.mobj - mobjs));
+    cl->bytesout[SVC_SETPLAYEDICT] += netbuf.len;
     netchan_queue(&cl->chan, &netbuf);
-    netbuf_free(&netbuf);
 
     return curpos;
 }
@@ -352,42 +429,101 @@ void* recvuse(client_t* cl, void* buf, void* curpos, int len)
     return curpos;
 }
 
+static void queuecmd(client_t* cl, const playercmd_t* cmd, int32_t seq)
+{
+    int slot;
+
+    if(cl->ncmds >= CMD_QUEUE)
+    {
+        cl->firstcmd = (cl->firstcmd + 1) % CMD_QUEUE;
+        cl->ncmds--;
+    }
+
+    slot = (cl->firstcmd + cl->ncmds++) % CMD_QUEUE;
+    cl->cmdqueue[slot] = *cmd;
+    cl->cmdseqs[slot] = seq;
+    cl->lastcmdseq = seq;
+}
+
+// runs queued commands until the client has used up this tic's worth of time
+static void runcmds(client_t* cl)
+{
+    playercmd_t *cmd;
+
+    cl->cmdbudget = MIN(cl->cmdbudget + 1.0 / TICRATE, CMD_MAXBUDGET);
+
+    while(cl->ncmds && cl->cmdbudget > 0)
+    {
+        cmd = &cl->cmdqueue[cl->firstcmd];
+
+        cl->buttons = cmd->flags;
+        player_docmd(&cl->player, cmd);
+        cl->player.lastcmd = *cmd;
+
+        cl->cmdbudget -= MAX(cmd->frametime, CMD_MINCOST);
+        cl->cmdrun = cl->cmdseqs[cl->firstcmd];
+        cl->firstcmd = (cl->firstcmd + 1) % CMD_QUEUE;
+        cl->ncmds--;
+    }
+}
+
 void* recvinput(client_t* cl, void* buf, void* curpos, int len)
 {
+    int i;
+
+    int32_t seq, cmdseq;
+    int n;
     playercmd_t cmd;
 
-    cmd.flags = net_readu8(buf, curpos++, len);
-    cmd.angle = net_readu32(buf, curpos, len);
-    curpos += 4;
-    cmd.switchwpn = net_readu8(buf, curpos++, len);
-    cmd.frametime = net_readfloat(buf, curpos, len);
+    seq = net_readi32(buf, curpos, len);
     curpos += 4;
-    
-    if(netpacketfull)
-        return NULL;
+    n = net_readu8(buf, curpos++, len);
+
+    for(i=0; i<n; i++)
+    {
+        cmdseq = seq - net_readu8(buf, curpos++, len);
+        cmd.flags = net_readu8(buf, curpos++, len);
+        cmd.angle = net_readu32(buf, curpos, len);
+        curpos += 4;
+        cmd.switchwpn = net_readu8(buf, curpos++, len);
+        cmd.frametime = net_readfloat(buf, curpos, len);
+        curpos += 4;
+        cmd.viewms = net_readi32(buf, curpos, len);
+        curpos += 4;
 
-    cl->buttons = cmd.flags;
-    player_docmd(&cl->player, &cmd);
+        if(netpacketfull)
+            return NULL;
 
-    cl->player.lastcmd = cmd;
+        // the budget is paid in frametime, so it has to be something the client could really have had
+        if(!isfinite(cmd.frametime) || cmd.frametime <= 0)
+            continue;
+        cmd.frametime = MIN(cmd.frametime, CMD_MAXFRAMETIME);
+
+        // the same command turns up in several packets, only the first one counts
+        if(cmdseq > cl->lastcmdseq)
+            queuecmd(cl, &cmd, cmdseq);
+    }
 
     return curpos;
 }
 
-static void recvpacket(client_t* cl, void* buf, int len)
+static void recvpacket(client_t* cl, void* packet, int packetlen)
 {
     uint8_t packettype;
 
-    void *curpos;
+    void *buf, *curpos, *start;
+    int len;
 
-    curpos = netchan_recv(&cl->chan, buf, len);
-    if(!curpos)
+    buf = netchan_recv(&cl->chan, packet, packetlen, &len);
+    if(!buf)
         return;
+    curpos = buf;
 
     cl->lastrecv = (uint32_t)time(NULL);
 
     while(1)
     {
+        start = curpos;
         packettype = net_readu8(buf, curpos++, len);
         if(netpacketfull)
             break;
@@ -413,6 +549,8 @@ static void recvpacket(client_t* cl, void* buf, int len)
             fprintf(stderr, "recvpacket: bad packet id %d from client %d\n", packettype, (int) (cl - clients));
             return;
         }
+
+        cl->bytesin[packettype] += curpos - start;
     }
 
     if(cl->state == CLSTATE_SHAKING && cl->chan.justgotack)
@@ -422,31 +560,32 @@ static void recvpacket(client_t* cl, void* buf, int len)
     }
 }
 
-static void processhandshake(int dc, void* buf, int len)
+static void processhandshake(int dc, void* packet, int packetlen)
 {
     int i, j;
 
-    void *curpos;
-    int32_t seq;
+    netchan_t shake;
+    void *buf, *curpos;
+    int len;
     int8_t packid;
-    char *username;
+    char username[USERNAME_LEN];
     netbuf_t reply;
+    uint8_t replydata[MAX_PACKET];
     int edict;
-    
-    curpos = buf;
-    seq = net_readi32(buf, curpos, len);
-    curpos += 4;
-    if(netpacketfull || !(seq & 0x80000000))
-        return;
-    
-    curpos += 6; // skip ack and qport
 
-    packid = net_readu8(buf, curpos++, len);
-    if(netpacketfull || packid != CVS_HANDSHAKE)
+    // a throwaway channel to read the first packet from an unknown peer
+    memset(&shake, 0, sizeof(netchan_t));
+    buf = netchan_recv(&shake, packet, packetlen, &len);
+    if(buf)
+    {
+        curpos = buf;
+        packid = net_readu8(buf, curpos++, len);
+        net_readdata(username, USERNAME_LEN, buf, curpos, len);
+    }
+    netchan_reset(&shake);
+
+    if(!buf || netpacketfull || packid != CVS_HANDSHAKE)
         return;
-    
-    username = curpos;
-    curpos += USERNAME_LEN;
 
     for(i=0; i<USERNAME_LEN; i++)
         if(!username[i])
@@ -459,29 +598,36 @@ static void processhandshake(int dc, void* buf, int len)
             break;
     if(i >= MAX_CLIENT)
     {
-        netbuf_init(&reply);
-        netbuf_writei32(&reply, 1);
-        netbuf_writei32(&reply, 0);
-        netbuf_writei16(&reply, 0);
+        netbuf_initstatic(&reply, replydata, sizeof(replydata));
         netbuf_writeu8(&reply, SVC_SERVERFULL);
-        net_send(dc, reply.data, reply.len);
-        netbuf_free(&reply);
+        netchan_send(&shake, dc, &reply);
+        netchan_reset(&shake);
         return;
     }
 
     clients[i].state = CLSTATE_SHAKING;
     clients[i].dc = dc;
     clients[i].lastrecv = (uint32_t)time(NULL);
-    clients[i].firstdeltaseq = INT_MAX;
+    clients[i].nsnapshots = 0;
+    memset(clients[i].snapseqs, 0, sizeof(clients[i].snapseqs));
+    clients[i].firstcmd = clients[i].ncmds = 0;
+    clients[i].lastcmdseq = clients[i].cmdrun = 0;
+    clients[i].cmdbudget = 0;
+    memset(clients[i].bytesin, 0, sizeof(clients[i].bytesin));
+    memset(clients[i].bytesout, 0, sizeof(clients[i].bytesout));
+    clients[i].bytesin[CVS_HANDSHAKE] = USERNAME_LEN + 1;
+    clients[i].sndacked = sndseq;
     strcpy(clients[i].username, username);
     
-    memset(&clients[i].chan, 0, sizeof(netchan_t));
-    netchan_recv(&clients[i].chan, buf, len);
+    // take the handshake chunk so it gets acked
+    netchan_reset(&clients[i].chan);
+    netchan_recv(&clients[i].chan, packet, packetlen, &len);
+    rate_reset(&clients[i]);
 
     spawnplayer(&clients[i]);
     edict = clients[i].player.mobj - mobjs;
 
-    netbuf_init(&reply);
+    netbuf_initstatic(&reply, replydata, sizeof(replydata));
     netbuf_writeu8(&reply, SVC_HANDSHAKE);
     netbuf_writei32(&reply, i);
 
@@ -496,9 +642,8 @@ static void processhandshake(int dc, void* buf, int len)
     netbuf_writeu8(&reply, SVC_SETPLAYEDICT);
     netbuf_writei32(&reply, edict);
 
+    clients[i].bytesout[SVC_HANDSHAKE] += reply.len;
     netchan_queue(&clients[i].chan, &reply);
-    
-    netbuf_free(&reply);
 }
 
 void recvfromclients(void)
@@ -542,6 +687,10 @@ void recvfromclients(void)
 
         recvpacket(&clients[i], buf, len);
     }
+
+    for(i=0; i<MAX_CLIENT; i++)
+        if(clients[i].state != CLSTATE_DC && clients[i].player.mobj)
+            runcmds(&clients[i]);
 }
 
 void spawnplayer(client_t* client)
@@ -563,6 +712,8 @@ void spawnplayer(client_t* client)
 
     memset(&client->player, 0, sizeof(player_t));
     player_initinfo(&client->player.info);
+    // each life picks up somewhere new in the table, the client is sent it with the first snapshot
+    client->player.info.rngindex = prand();
     player_addthinker(&client->player);
     client->player.mobj = &mobjs[edict];
     memset(client->player.mobj, 0, sizeof(object_t));
@@ -7,10 +7,18 @@
 #include "netchan.h"
 #include "packets.h"
 #include "player.h"
+#include "rate.h"
 
 #define MAX_CLIENT 11
-#define GAMESTATE_WINDOW 32
 #define CLIENT_TIMEOUT 30
+// commands waiting to be run, past this the oldest are dropped
+#define CMD_QUEUE 64
+// the most a client can get ahead of real time by, in seconds of commands
+#define CMD_MAXBUDGET (4.0 / TICRATE)
+// longest frame a command may cover, same as the client caps it at
+#define CMD_MAXFRAMETIME 0.1f
+// every command costs at least this much, so a flood of tiny ones can't run unbounded
+#define CMD_MINCOST (1.0f / 1000)
 
 typedef int8_t addr_t[4];
 
@@ -21,22 +29,50 @@ typedef enum
     CLSTATE_CONNECTED,
 } clstate_e;
 
-typedef struct
+typedef struct client_s
 {
+    // the last GAMESTATE_WINDOW snapshots sent, slot nsnapshots % GAMESTATE_WINDOW is next.
+    // snapseqs is the outseq each went out with (0 if the slot is empty), snaptics the tic
+    // it was built on, snapbytes its size and sndseqs the newest sound event at the time.
+    // snapsettled is set once the rate control has counted it as arrived or lost
     gamestate_t gamestates[GAMESTATE_WINDOW];
     playerinfo_t playstates[GAMESTATE_WINDOW];
+    int32_t snapseqs[GAMESTATE_WINDOW];
+    int32_t snaptics[GAMESTATE_WINDOW];
+    int32_t snapbytes[GAMESTATE_WINDOW];
+    bool snapsettled[GAMESTATE_WINDOW];
+    int32_t sndseqs[GAMESTATE_WINDOW];
+    int32_t nsnapshots;
+    int32_t sndacked;
 
     uint8_t buttons;
 
+    // commands come in with sequence numbers, each is queued once and run at about real time.
+    // cmdqueue[(firstcmd + i) % CMD_QUEUE] is the i'th oldest waiting
+    playercmd_t cmdqueue[CMD_QUEUE];
+    int32_t cmdseqs[CMD_QUEUE];
+    int firstcmd, ncmds;
+    int32_t lastcmdseq; // newest queued
+    int32_t cmdrun; // newest run, snapshots tell the client so it knows what to predict
+    float cmdbudget; // seconds of commands that can run before the next tic's worth comes in
+
+    // payload bytes by message type since the client connected, not counting netchan headers
+    int64_t bytesin[NUM_PACKETS];
+    int64_t bytesout[NUM_PACKETS];
+
     netchan_t chan;
+    ratectl_t rate;
     clstate_e state;
     player_t player;
     char username[USERNAME_LEN];
     int dc;
     uint32_t lastrecv;
-    int firstdeltaseq;
 } client_t;
 
+extern int ntics;
+// tics between snapshots when the link is good
+extern int snapshotinterval;
+
 extern gamestate_t dummystate;
 
 extern client_t clients[MAX_CLIENT];
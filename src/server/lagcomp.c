@@ -0,0 +1,109 @@
+#include "lagcomp.h"
+
+#include "client.h"
+
+typedef struct
+{
+    object_t *mobj;
+    float x, y, z;
+} lagsave_t;
+
+static lagsave_t saved[MAX_MOBJ];
+static int nsaved = 0;
+
+// the newest snapshot sent to cl built at or before tic and the oldest after it, -1 for none
+static void lagcomp_bracket(client_t* cl, float tic, int* from, int* to)
+{
+    int i;
+
+    *from = *to = -1;
+    for(i=0; i<GAMESTATE_WINDOW; i++)
+    {
+        if(!cl->snapseqs[i])
+            continue;
+
+        if(cl->snaptics[i] <= tic)
+        {
+            if(*from < 0 || cl->snaptics[i] > cl->snaptics[*from])
+                *from = i;
+        }
+        else if(*to < 0 || cl->snaptics[i] < cl->snaptics[*to])
+            *to = i;
+    }
+}
+
+void lagcomp_rewind(player_t* player)
+{
+    int i;
+
+    client_t *cl;
+    float tic, t;
+    int from, to;
+    objinfo_t *old, *new;
+    object_t *mobj;
+
+    nsaved = 0;
+
+    for(i=0; i<MAX_CLIENT; i++)
+        if(&clients[i].player == player)
+            break;
+    if(i >= MAX_CLIENT || clients[i].state != CLSTATE_CONNECTED)
+        return;
+    cl = &clients[i];
+
+    // a client that hasn't synced its clock yet doesn't know what it's looking at
+    if(player->lastcmd.viewms <= 0)
+        return;
+
+    tic = player->lastcmd.viewms / 1000.0 * TICRATE;
+    tic = CLAMP(tic, ntics - LAGCOMP_MAXREWIND * TICRATE, ntics);
+
+    lagcomp_bracket(cl, tic, &from, &to);
+    if(from < 0)
+        return;
+
+    t = to < 0 ? 0 : (tic - cl->snaptics[from]) / (float) (cl->snaptics[to] - cl->snaptics[from]);
+
+    for(i=0; i<=mobjmax; i++)
+    {
+        mobj = &mobjs[i];
+        if(mobj == player->mobj || !mobj->info.exists || !(mobj->info.flags & MF_SHOOTABLE))
+            continue;
+
+        // only things that were there then can be moved back to where they were
+        old = &cl->gamestates[from].mobjs[i];
+        new = to < 0 ? old : &cl->gamestates[to].mobjs[i];
+        if(i > cl->gamestates[from].maxmobj || !old->exists || old->type != mobj->info.type)
+            continue;
+        if(to >= 0 && (i > cl->gamestates[to].maxmobj || !new->exists))
+            new = old;
+
+        saved[nsaved].mobj = mobj;
+        saved[nsaved].x = mobj->info.x;
+        saved[nsaved].y = mobj->info.y;
+        saved[nsaved].z = mobj->info.z;
+        nsaved++;
+
+        level_unplacemobj(mobj);
+        mobj->info.x = LERP(old->x, new->x, t);
+        mobj->info.y = LERP(old->y, new->y, t);
+        mobj->info.z = LERP(old->z, new->z, t);
+        level_placemobj(mobj);
+    }
+}
+
+void lagcomp_restore(void)
+{
+    int i;
+
+    for(i=0; i<nsaved; i++)
+    {
+        level_unplacemobj(saved[i].mobj);
+        saved[i].mobj->info.x = saved[i].x;
+        saved[i].mobj->info.y = saved[i].y;
+        saved[i].mobj->info.z = saved[i].z;
+        level_placemobj(saved[i].mobj);
+    }
+
+    nsaved = 0;
+}
@@ -0,0 +1,15 @@
+#ifndef _LAGCOMP_H
+#define _LAGCOMP_H
+
+#include "player.h"
+
+// never rewinds further back than this many seconds
+#define LAGCOMP_MAXREWIND 0.25
+
+// moves shootable mobjs back to where player's client was showing them when it gave
+// its last command, as near as the snapshots it was sent can say.
+// does nothing for players that aren't a client's. every rewind needs a lagcomp_restore
+void lagcomp_rewind(player_t* player);
+void lagcomp_restore(void);
+
+#endif
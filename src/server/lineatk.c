@@ -1,24 +1,29 @@
 #include "lineatk.h"
 
-float linez;
-float topslope, botslope;
-float lineslope;
-float aimdst;
-object_t *atkmobj;
-bool dealtdamage;
-int linedmg;
-
-static bool aimlinecol(float x1, float y1, float x2, float y2, linedef_t* line, float t)
+typedef struct
 {
+    object_t *mobj;
+    float z;
+    float dist;
+    float topslope, botslope;
+    float slope;
+    int dmg;
+    bool dealtdamage;
+} lineatkctx_t;
+
+static bool aimlinecol(float x1, float y1, float x2, float y2, linedef_t* line, float t, void* ctx)
+{
+    lineatkctx_t *atk;
     float dist, bottom, top, lbotslope, ltopslope;
 
-    dist = t * aimdst;
+    atk = ctx;
+    dist = t * atk->dist;
 
     if(!line->back || !line->back->sector)
         return true;
 
-    bottom = level_linelower(line) - linez;
-    top = level_lineupper(line) - linez;
+    bottom = level_linelower(line) - atk->z;
+    top = level_lineupper(line) - atk->z;
 
     if(bottom >= top)
         return true;
@@ -26,29 +31,32 @@ static bool aimlinecol(float x1, float y1, float x2, float y2, linedef_t* line,
     lbotslope = bottom / dist;
     ltopslope = top / dist;
 
-    topslope = MIN(topslope, ltopslope);
-    botslope = MAX(botslope, lbotslope);
+    atk->topslope = MIN(atk->topslope, ltopslope);
+    atk->botslope = MAX(atk->botslope, lbotslope);
 
-    if(botslope >= topslope)
+    if(atk->botslope >= atk->topslope)
         return true;
 
     return false;
 }
 
-static bool aimmobjcol(float x1, float y1, float x2, float y2, object_t* mobj, float t)
+static bool aimmobjcol(float x1, float y1, float x2, float y2, object_t* mobj, float t, void* ctx)
 {
+    lineatkctx_t *atk;
     float dist;
     float mobjtop, mobjbottom, mtopslope, mbotslope;
 
-    if(mobj == atkmobj)
+    atk = ctx;
+
+    if(mobj == atk->mobj)
         return false;
 
     if(!(mobj->info.flags & MF_SHOOTABLE))
         return false;
 
-    dist = aimdst * t;
+    dist = atk->dist * t;
 
-    mobjbottom = mobj->info.z - linez;
+    mobjbottom = mobj->info.z - atk->z;
     mobjtop = mobjbottom + mobjinfo[mobj->info.type].height;
 
     mbotslope = mobjbottom / dist;
@@ -57,13 +65,13 @@ static bool aimmobjcol(float x1, float y1, float x2, float y2, object_t* mobj, f
     if(mbotslope >= mtopslope)
         return false;
 
-    if(mbotslope >= topslope)
+    if(mbotslope >= atk->topslope)
         return false;
 
-    if(mtopslope <= botslope)
+    if(mtopslope <= atk->botslope)
         return false;
 
-    lineslope = LERP(mbotslope, mtopslope, 0.5);
+    atk->slope = LERP(mbotslope, mtopslope, 0.5);
 
     return true;
 }
@@ -72,40 +80,43 @@ float lineatk_findslope(object_t* mobj, angle_t ang)
 {
     float x1, x2, y1, y2;
     float cosang, sinang;
+    lineatkctx_t atk;
 
-    atkmobj = mobj;
+    atk.mobj = mobj;
 
     cosang = ANGCOS(ang);
     sinang = ANGSIN(ang);
 
-    aimdst = 1024;
+    atk.dist = 1024;
 
     x1 = mobj->info.x;
     y1 = mobj->info.y;
-    x2 = x1 + cosang * aimdst;
-    y2 = y1 + sinang * aimdst;
+    x2 = x1 + cosang * atk.dist;
+    y2 = y1 + sinang * atk.dist;
 
-    linez = mobj->info.z + (mobjinfo[mobj->info.type].height / 2.0) + 8;
-    topslope = 0.625;
-    botslope = -0.625;
-    lineslope = 0;
+    atk.z = mobj->info.z + (mobjinfo[mobj->info.type].height / 2.0) + 8;
+    atk.topslope = 0.625;
+    atk.botslope = -0.625;
+    atk.slope = 0;
 
-    level_traverseline(x1, y1, x2, y2, false, aimlinecol, aimmobjcol);
+    level_traverseline(x1, y1, x2, y2, false, aimlinecol, aimmobjcol, &atk);
 
-    return lineslope;
+    return atk.slope;
 }
 
-static bool atklinecol(float x1, float y1, float x2, float y2, linedef_t* line, float t)
+static bool atklinecol(float x1, float y1, float x2, float y2, linedef_t* line, float t, void* ctx)
 {
+    lineatkctx_t *atk;
     float dist, bottom, top, lbotslope, ltopslope;
 
-    dist = t * aimdst;
+    atk = ctx;
+    dist = t * atk->dist;
 
     if(!line->back || !line->back->sector)
         return true;
 
-    bottom = level_linelower(line) - linez;
-    top = level_lineupper(line) - linez;
+    bottom = level_linelower(line) - atk->z;
+    top = level_lineupper(line) - atk->z;
 
     if(bottom >= top)
         return true;
@@ -113,28 +124,31 @@ static bool atklinecol(float x1, float y1, float x2, float y2, linedef_t* line,
     lbotslope = bottom / dist;
     ltopslope = top / dist;
 
-    if(lbotslope >= lineslope)
+    if(lbotslope >= atk->slope)
         return true;
-    if(ltopslope <= lineslope)
+    if(ltopslope <= atk->slope)
         return true;
 
     return false;
 }
 
-static bool atkmobjcol(float x1, float y1, float x2, float y2, object_t* mobj, float t)
+static bool atkmobjcol(float x1, float y1, float x2, float y2, object_t* mobj, float t, void* ctx)
 {
+    lineatkctx_t *atk;
     float dist;
     float mobjtop, mobjbottom, mtopslope, mbotslope;
 
-    if(mobj == atkmobj)
+    atk = ctx;
+
+    if(mobj == atk->mobj)
         return false;
 
     if(!(mobj->info.flags & MF_SHOOTABLE))
         return false;
 
-    dist = aimdst * t;
+    dist = atk->dist * t;
 
-    mobjbottom = mobj->info.z - linez;
+    mobjbottom = mobj->info.z - atk->z;
     mobjtop = mobjbottom + mobjinfo[mobj->info.type].height;
 
     mbotslope = mobjbottom / dist;
@@ -143,14 +157,14 @@ static bool atkmobjcol(float x1, float y1, float x2, float y2, object_t* mobj, f
     if(mbotslope >= mtopslope)
         return false;
 
-    if(mbotslope > lineslope)
+    if(mbotslope > atk->slope)
         return false;
 
-    if(mtopslope < lineslope)
+    if(mtopslope < atk->slope)
         return false;
 
-    dealtdamage = true;
-    level_damagemobj(mobj, linedmg, atkmobj, atkmobj);
+    atk->dealtdamage = true;
+    level_damagemobj(mobj, atk->dmg, atk->mobj, atk->mobj);
     return true;
 }
 
@@ -158,25 +172,26 @@ bool lineatk(int dmg, object_t* mobj, angle_t ang, float dist, float slope)
 {
     float x1, x2, y1, y2;
     float cosang, sinang;
+    lineatkctx_t atk;
 
-    atkmobj = mobj;
-    linedmg = dmg;
+    atk.mobj = mobj;
+    atk.dmg = dmg;
 
     cosang = ANGCOS(ang);
     sinang = ANGSIN(ang);
 
-    aimdst = 1024;
+    atk.dist = 1024;
 
     x1 = mobj->info.x;
     y1 = mobj->info.y;
-    x2 = x1 + cosang * aimdst;
-    y2 = y1 + sinang * aimdst;
+    x2 = x1 + cosang * atk.dist;
+    y2 = y1 + sinang * atk.dist;
 
-    linez = mobj->info.z + (mobjinfo[mobj->info.type].height / 2.0) + 8;
-    lineslope = slope;
+    atk.z = mobj->info.z + (mobjinfo[mobj->info.type].height / 2.0) + 8;
+    atk.slope = slope;
 
-    dealtdamage = false;
-    level_traverseline(x1, y1, x2, y2, false, atklinecol, atkmobjcol);
+    atk.dealtdamage = false;
+    level_traverseline(x1, y1, x2, y2, false, atklinecol, atkmobjcol, &atk);
 
-    return dealtdamage;
+    return atk.dealtdamage;
 }
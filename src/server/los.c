@@ -1,31 +1,38 @@
 #include "los.h"
 
-float sightdist, sightz, sighttopslope, sightbotslope;
-bool sightblocked;
+typedef struct
+{
+    float dist, z;
+    float topslope, botslope;
+    bool blocked;
+} sightctx_t;
 
-static bool lineofsight_col(float x1, float y1, float x2, float y2, linedef_t* line, float t)
+static bool lineofsight_col(float x1, float y1, float x2, float y2, linedef_t* line, float t, void* ctx)
 {
+    sightctx_t *sight;
     float lower, upper;
     float botslope, topslope;
 
+    sight = ctx;
+
     if(!line->back || !line->front)
     {
-        sightblocked = true;
+        sight->blocked = true;
         return true;
     }
 
     lower = level_linelower(line);
     upper = level_lineupper(line);
 
-    botslope = (lower - sightz) / (t * sightdist);
-    topslope = (upper - sightz) / (t * sightdist);
+    botslope = (lower - sight->z) / (t * sight->dist);
+    topslope = (upper - sight->z) / (t * sight->dist);
 
-    sighttopslope = MIN(sighttopslope, topslope);
-    sightbotslope = MAX(sightbotslope, botslope);
+    sight->topslope = MIN(sight->topslope, topslope);
+    sight->botslope = MAX(sight->botslope, botslope);
 
-    if(sightbotslope >= sighttopslope)
+    if(sight->botslope >= sight->topslope)
     {
-        sightblocked = true;
+        sight->blocked = true;
         return true;
     }
 
@@ -34,14 +41,16 @@ static bool lineofsight_col(float x1, float y1, float x2, float y2, linedef_t* l
 
 bool lineofsight(object_t* a, object_t* b)
 {
-    sightz = a->info.z + a->info.height / 2.0;
-    sightdist = magnitude(b->info.x - a->info.x, b->info.y - a->info.y);
+    sightctx_t sight;
+
+    sight.z = a->info.z + a->info.height / 2.0;
+    sight.dist = magnitude(b->info.x - a->info.x, b->info.y - a->info.y);
 
-    sightbotslope = (b->info.z - sightz) / sightdist;
-    sighttopslope = (b->info.z + b->info.height - sightz) / sightdist;
+    sight.botslope = (b->info.z - sight.z) / sight.dist;
+    sight.topslope = (b->info.z + b->info.height - sight.z) / sight.dist;
 
-    sightblocked = false;
-    level_traverseline(a->info.x, a->info.y, b->info.x, b->info.y, false, lineofsight_col, NULL);
+    sight.blocked = false;
+    level_traverseline(a->info.x, a->info.y, b->info.x, b->info.y, false, lineofsight_col, NULL, &sight);
 
-    return !sightblocked;
+    return !sight.blocked;
 }
\ No newline at end of file
@@ -1,14 +1,19 @@
 #include <arpa/inet.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/time.h>
 #include <unistd.h>
 
+#include "capture.h"
 #include "client.h"
 #include "net.h"
+#include "netsim.h"
+#include "netstats.h"
 #include "wad.h"
 #include "level.h"
+#include "parthink.h"
 #include "think.h"
 
 #define TICRATE         35
@@ -27,14 +32,18 @@ static void tic(void)
 {
     recvfromclients();
 
-    think(1.0 / TICRATE, (float) ntics / TICRATE);
+    parthink(1.0 / TICRATE, (float) ntics / TICRATE);
 
     sendtoclients();
 
+    netstats_update();
+
     ntics++;
 }
 
 int ep = -1, map = -1;
+int nthinkthreads = 1;
+char *capturepath = NULL;
 
 static void filldummygs(void)
 {
@@ -55,6 +64,8 @@ static void parseargs(int argc, char** argv)
 {
     int i;
 
+    int nused;
+
     for(i=0; i<argc; i++)
     {
         if((!strcasecmp(argv[i], "-i") || !strcasecmp(argv[i], "-iwad")) && i < argc-1)
@@ -70,6 +81,38 @@ static void parseargs(int argc, char** argv)
             if(ep < 1 || ep > 4 || map < 1 || map > 9)
                 ep = map = -1;
         }
+        else if(!strcasecmp(argv[i], "-threads") && i < argc-1)
+        {
+            nthinkthreads = atoi(argv[i+1]);
+            i++;
+        }
+        else if(!strcasecmp(argv[i], "-snapinterval") && i < argc-1)
+        {
+            snapshotinterval = MAX(1, atoi(argv[i+1]));
+            i++;
+        }
+        else if(!strcasecmp(argv[i], "-rate") && i < argc-1)
+        {
+            clientrate = MAX(1000, atoi(argv[i+1]));
+            i++;
+        }
+        else if(!strcasecmp(argv[i], "-maxrate") && i < argc-1)
+        {
+            serverrate = MAX(0, atoi(argv[i+1]));
+            i++;
+        }
+        else if(!strcasecmp(argv[i], "-capture") && i < argc-1)
+        {
+            capturepath = argv[i+1];
+            i++;
+        }
+        else if(!strcasecmp(argv[i], "-netstats") && i < argc-1)
+        {
+            netstatsinterval = MAX(0, atoi(argv[i+1]));
+            i++;
+        }
+        else if((nused = netsim_parsearg(argc, argv, i)))
+            i += nused - 1;
     }
 }
 
@@ -86,10 +129,14 @@ int main(int argc, char** argv)
     }
 
     level_load(ep, map);
+    parthink_init(nthinkthreads);
     allocgamestatesectors();
     filldummygs();
 
     net_init();
+    netstats_init();
+    if(capturepath && !capture_open(capturepath))
+        return 1;
     player_init();
 
     nexttic = nowmicro();
@@ -1,5 +1,6 @@
 #include "net.h"
 #include "client.h"
+#include "netsim.h"
 #include <rtc/rtc.h>
 #include <cJSON.h>
 #include <stdio.h>
@@ -7,6 +8,7 @@
 #include <string.h>
 #include <stdint.h>
 #include <pthread.h>
+#include <time.h>
 
 // ---- Receive queue ----
 
@@ -261,13 +263,35 @@ void net_init(void)
     printf("[net] initialized, waiting for peers...\n");
 }
 
-int net_send(int dc, const void *data, int size)
+double net_time(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int net_rawsend(int dc, const void *data, int size)
 {
     if(!dc)
         return -1;
     return rtcSendMessage(dc, (const char *)data, size);
 }
 
+int net_send(int dc, const void *data, int size)
+{
+    if(netsim_enabled)
+        return netsim_send(dc, data, size);
+    return net_rawsend(dc, data, size);
+}
+
+int net_buffered(int dc)
+{
+    if(!dc)
+        return 0;
+    return rtcGetBufferedAmount(dc);
+}
+
 int net_recv_pending(void)
 {
     pthread_mutex_lock(&queue_mutex);
@@ -276,7 +300,7 @@ int net_recv_pending(void)
     return count;
 }
 
-int net_recv(void *buf, int buf_size, int *dc_out)
+int net_rawrecv(void *buf, int buf_size, int *dc_out)
 {
     pthread_mutex_lock(&queue_mutex);
     if (queue_count == 0) {
@@ -293,6 +317,13 @@ int net_recv(void *buf, int buf_size, int *dc_out)
     return copy;
 }
 
+int net_recv(void *buf, int buf_size, int *dc_out)
+{
+    if(netsim_enabled)
+        return netsim_recv(buf, buf_size, dc_out);
+    return net_rawrecv(buf, buf_size, dc_out);
+}
+
 int net_connected(void)
 {
     return true;
@@ -0,0 +1,279 @@
+#include "netsim.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include "client.h"
+#include "net.h"
+
+#define NETSIM_QUEUE 1024
+// packets held back for reordering wait this much longer than they would have
+#define NETSIM_REORDERMS 20
+
+typedef struct
+{
+    bool used;
+    bool incoming;
+    int dc;
+    uint64_t due; // microseconds
+    int size;
+    uint8_t data[NET_MAX_PACKET_SIZE];
+} simpacket_t;
+
+typedef struct
+{
+    int dc;
+    int burstleft[2]; // packets left to drop in the current run, by direction
+    uint64_t busyuntil[2]; // when the bandwidth cap frees up, by direction
+} simlink_t;
+
+bool netsim_enabled = false;
+
+static netsimcfg_t defaultcfg = {};
+static netsimcfg_t clientcfgs[MAX_CLIENT];
+static bool hasclientcfg[MAX_CLIENT];
+
+static simpacket_t queue[NETSIM_QUEUE];
+static simlink_t links[MAX_CLIENT];
+static int nlinks = 0;
+
+// its own generator so a -simseed run drops the same packets each time,
+// whatever the game does with prand and mrand
+static uint32_t simseed = 1;
+
+static float netsim_random(void)
+{
+    simseed ^= simseed << 13;
+    simseed ^= simseed >> 17;
+    simseed ^= simseed << 5;
+    return (simseed >> 8) / (float) (1 << 24);
+}
+
+static uint64_t netsim_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static netsimcfg_t* netsim_cfg(int dc)
+{
+    int i;
+
+    for(i=0; i<MAX_CLIENT; i++)
+        if(clients[i].state != CLSTATE_DC && clients[i].dc == dc && hasclientcfg[i])
+            return &clientcfgs[i];
+
+    return &defaultcfg;
+}
+
+static simlink_t* netsim_link(int dc)
+{
+    int i;
+
+    for(i=0; i<nlinks; i++)
+        if(links[i].dc == dc)
+            return &links[i];
+
+    // reuse the oldest if there's been a lot of churn
+    if(nlinks >= MAX_CLIENT)
+    {
+        memmove(links, links + 1, (MAX_CLIENT - 1) * sizeof(simlink_t));
+        nlinks--;
+    }
+
+    memset(&links[nlinks], 0, sizeof(simlink_t));
+    links[nlinks].dc = dc;
+    return &links[nlinks++];
+}
+
+static void netsim_enqueue(bool incoming, int dc, uint64_t due, const void* data, int size)
+{
+    int i;
+
+    for(i=0; i<NETSIM_QUEUE; i++)
+        if(!queue[i].used)
+            break;
+
+    // a full queue is just more loss
+    if(i >= NETSIM_QUEUE)
+        return;
+
+    queue[i].used = true;
+    queue[i].incoming = incoming;
+    queue[i].dc = dc;
+    queue[i].due = due;
+    queue[i].size = size;
+    memcpy(queue[i].data, data, size);
+}
+
+// runs a packet through the link's impairments and queues whatever survives
+static void netsim_impair(bool incoming, int dc, const void* data, int size)
+{
+    netsimcfg_t *cfg;
+    simlink_t *link;
+    uint64_t now, due;
+    int dir;
+
+    cfg = netsim_cfg(dc);
+    link = netsim_link(dc);
+    dir = incoming;
+    now = netsim_now();
+
+    if(link->burstleft[dir] > 0)
+    {
+        link->burstleft[dir]--;
+        return;
+    }
+    if(cfg->burstchance > 0 && netsim_random() < cfg->burstchance)
+    {
+        link->burstleft[dir] = (int) (netsim_random() * 2 * MAX(cfg->burstlen, 1));
+        return;
+    }
+    if(netsim_random() < cfg->loss)
+        return;
+
+    // serialization delay, packets queue behind each other on a capped link
+    due = now;
+    if(cfg->bandwidth > 0)
+    {
+        due = MAX(now, link->busyuntil[dir]) + (uint64_t) size * 1000000 / cfg->bandwidth;
+        link->busyuntil[dir] = due;
+    }
+
+    due += (uint64_t) cfg->delay * 1000;
+    if(cfg->jitter > 0)
+        due += (int64_t) ((netsim_random() * 2 - 1) * cfg->jitter * 1000);
+    if(netsim_random() < cfg->reorder)
+        due += (uint64_t) (NETSIM_REORDERMS + cfg->jitter) * 1000;
+    due = MAX(due, now);
+
+    netsim_enqueue(incoming, dc, due, data, size);
+    if(netsim_random() < cfg->dup)
+        netsim_enqueue(incoming, dc, due + (uint64_t) (netsim_random() * (cfg->jitter + 1) * 1000), data, size);
+}
+
+// the queued packet going the given way that was due first, or -1 if none is due yet.
+// taking them in due order is what makes delays and reordering come out right
+static int netsim_nextdue(bool incoming, uint64_t now)
+{
+    int i;
+
+    int best;
+
+    best = -1;
+    for(i=0; i<NETSIM_QUEUE; i++)
+    {
+        if(!queue[i].used || queue[i].incoming != incoming || queue[i].due > now)
+            continue;
+        if(best < 0 || queue[i].due < queue[best].due)
+            best = i;
+    }
+
+    return best;
+}
+
+// sends every outgoing packet that's due, earliest first
+static void netsim_flush(void)
+{
+    int i;
+
+    uint64_t now;
+
+    now = netsim_now();
+    while((i = netsim_nextdue(false, now)) >= 0)
+    {
+        net_rawsend(queue[i].dc, queue[i].data, queue[i].size);
+        queue[i].used = false;
+    }
+}
+
+int netsim_send(int dc, const void* data, int size)
+{
+    if(!dc)
+        return -1;
+    if(size <= 0 || size > NET_MAX_PACKET_SIZE)
+        return net_rawsend(dc, data, size);
+
+    netsim_impair(false, dc, data, size);
+    netsim_flush();
+    return size;
+}
+
+int netsim_recv(void* buf, int bufsize, int* dc_out)
+{
+    uint8_t packet[NET_MAX_PACKET_SIZE];
+    int len, dc, best;
+
+    // recv is called every tic, so this is where delayed sends go out too
+    netsim_flush();
+
+    while((len = net_rawrecv(packet, sizeof(packet), &dc)) > 0)
+        netsim_impair(true, dc, packet, len);
+
+    best = netsim_nextdue(true, netsim_now());
+    if(best < 0)
+        return 0;
+
+    len = MIN(queue[best].size, bufsize);
+    memcpy(buf, queue[best].data, len);
+    if(dc_out)
+        *dc_out = queue[best].dc;
+    queue[best].used = false;
+
+    return len;
+}
+
+int netsim_parsearg(int argc, char** argv, int i)
+{
+    static netsimcfg_t *cfg = &defaultcfg;
+
+    int slot;
+
+    if(!strcasecmp(argv[i], "-simclient") && i < argc-1)
+    {
+        slot = atoi(argv[i+1]);
+        if(slot < 0 || slot >= MAX_CLIENT)
+            return 2;
+
+        // starts from whatever was given for everyone so far
+        if(!hasclientcfg[slot])
+            clientcfgs[slot] = defaultcfg;
+        hasclientcfg[slot] = true;
+        cfg = &clientcfgs[slot];
+        return 2;
+    }
+    else if(!strcasecmp(argv[i], "-simseed") && i < argc-1)
+    {
+        simseed = MAX(1, atoi(argv[i+1]));
+        return 2;
+    }
+    else if(!strcasecmp(argv[i], "-simdelay") && i < argc-1)
+        cfg->delay = MAX(0, atoi(argv[i+1]));
+    else if(!strcasecmp(argv[i], "-simjitter") && i < argc-1)
+        cfg->jitter = MAX(0, atoi(argv[i+1]));
+    else if(!strcasecmp(argv[i], "-simloss") && i < argc-1)
+        cfg->loss = atof(argv[i+1]) / 100;
+    else if(!strcasecmp(argv[i], "-simburst") && i < argc-2)
+    {
+        cfg->burstchance = atof(argv[i+1]) / 100;
+        cfg->burstlen = atoi(argv[i+2]);
+        netsim_enabled = true;
+        return 3;
+    }
+    else if(!strcasecmp(argv[i], "-simreorder") && i < argc-1)
+        cfg->reorder = atof(argv[i+1]) / 100;
+    else if(!strcasecmp(argv[i], "-simdup") && i < argc-1)
+        cfg->dup = atof(argv[i+1]) / 100;
+    else if(!strcasecmp(argv[i], "-simbw") && i < argc-1)
+        cfg->bandwidth = MAX(0, atoi(argv[i+1]));
+    else
+        return 0;
+
+    netsim_enabled = true;
+    return 2;
+}
@@ -0,0 +1,32 @@
+#ifndef _NETSIM_H
+#define _NETSIM_H
+
+#include <stdbool.h>
+
+// impairments applied to each direction of a client's link
+typedef struct
+{
+    int delay; // ms
+    int jitter; // ms, delay varies by up to this much either way
+    float loss; // chance a packet is dropped
+    float burstchance; // chance a packet starts a run of drops
+    int burstlen; // packets in a run, on average
+    float reorder; // chance a packet is held back behind the ones after it
+    float dup; // chance a packet arrives twice
+    int bandwidth; // bytes per second, 0 for no cap
+} netsimcfg_t;
+
+extern bool netsim_enabled;
+
+// handles -sim* arguments. returns how many arguments were used, 0 if argv[i] isn't one.
+// -simclient n makes the ones after it apply only to client slot n
+int netsim_parsearg(int argc, char** argv, int i);
+// stand-ins for net_send and net_recv while the sim is on
+int netsim_send(int dc, const void* data, int size);
+int netsim_recv(void* buf, int bufsize, int* dc_out);
+
+// the real transport underneath, in net.c
+int net_rawsend(int dc, const void* data, int size);
+int net_rawrecv(void* buf, int bufsize, int* dc_out);
+
+#endif
@@ -0,0 +1,129 @@
+#include "netstats.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "client.h"
+#include "net.h"
+
+int netstatsinterval = 0;
+
+static volatile sig_atomic_t reportrequested = 0;
+static double lastreport = 0;
+
+// counters as of the last report, to turn totals into rates
+typedef struct
+{
+    int64_t bytesin, bytesout;
+    int32_t received, lost;
+    int64_t typein[NUM_PACKETS], typeout[NUM_PACKETS];
+} netsample_t;
+
+static netsample_t samples[MAX_CLIENT];
+
+static const char* packetnames[NUM_PACKETS] =
+{
+    [CVS_HANDSHAKE] = "handshake",
+    [SVC_SERVERFULL] = "serverfull",
+    [SVC_HANDSHAKE] = "handshake",
+    [SVC_CHANGELEVEL] = "changelevel",
+    [SVC_ENTDELTAS] = "entdeltas",
+    [CSV_INPUT] = "input",
+    [CSV_USE] = "use",
+    [SVC_PLAYERDELTAS] = "playerdeltas",
+    [SVC_SOUNDEVENTS] = "soundevents",
+    [SVC_SETPLAYEDICT] = "setplayedict",
+    [CSV_RESPAWN] = "respawn",
+    [SVC_PICKUP] = "pickup",
+    [SVC_SNAPSHOT] = "snapshot",
+};
+
+static void netstats_onsignal(int sig)
+{
+    reportrequested = 1;
+}
+
+// a counter that went backwards belongs to a new connection in the slot
+static int64_t netstats_delta(int64_t now, int64_t then)
+{
+    return now >= then ? now - then : now;
+}
+
+static void netstats_printtypes(const char* dir, int64_t* now, int64_t* then, double dt)
+{
+    int i;
+
+    int64_t d;
+
+    printf("    %s:", dir);
+    for(i=0; i<NUM_PACKETS; i++)
+    {
+        d = netstats_delta(now[i], then[i]);
+        if(d)
+            printf(" %s %.0f", packetnames[i], d / dt);
+    }
+    printf("\n");
+}
+
+static void netstats_report(double dt)
+{
+    int i;
+
+    client_t *cl;
+    netstats_t *stats;
+    netsample_t *sample;
+    int32_t received, lost;
+
+    for(i=0; i<MAX_CLIENT; i++)
+    {
+        cl = &clients[i];
+        stats = &cl->chan.stats;
+        sample = &samples[i];
+        if(cl->state == CLSTATE_DC)
+        {
+            memset(sample, 0, sizeof(netsample_t));
+            continue;
+        }
+
+        received = netstats_delta(stats->received, sample->received);
+        lost = netstats_delta(stats->lost, sample->lost);
+
+        printf("client %d (%s): rtt %.1fms jitter %.1fms loss %.1f%% in %.0fB/s out %.0fB/s rate %.0fB/s every %d tics\n",
+            i, cl->username, stats->rtt * 1000, stats->jitter * 1000,
+            received + lost ? 100.0 * lost / (received + lost) : 0.0,
+            netstats_delta(stats->bytesin, sample->bytesin) / dt,
+            netstats_delta(stats->bytesout, sample->bytesout) / dt,
+            cl->rate.rate, cl->rate.interval);
+        netstats_printtypes("in", cl->bytesin, sample->typein, dt);
+        netstats_printtypes("out", cl->bytesout, sample->typeout, dt);
+
+        sample->bytesin = stats->bytesin;
+        sample->bytesout = stats->bytesout;
+        sample->received = stats->received;
+        sample->lost = stats->lost;
+        memcpy(sample->typein, cl->bytesin, sizeof(sample->typein));
+        memcpy(sample->typeout, cl->bytesout, sizeof(sample->typeout));
+    }
+
+    fflush(stdout);
+}
+
+void netstats_init(void)
+{
+    signal(SIGUSR1, netstats_onsignal);
+    lastreport = net_time();
+}
+
+void netstats_update(void)
+{
+    double now;
+
+    now = net_time();
+    if(!reportrequested && (!netstatsinterval || now - lastreport < netstatsinterval))
+        return;
+
+    reportrequested = 0;
+    netstats_report(MAX(now - lastreport, 0.001));
+    lastreport = now;
+}
@@ -0,0 +1,11 @@
+#ifndef _NETSTATS_H
+#define _NETSTATS_H
+
+// seconds between connection reports, 0 for only when the server gets SIGUSR1
+extern int netstatsinterval;
+
+void netstats_init(void);
+// call once a tic, prints a report for every client when one is due
+void netstats_update(void);
+
+#endif
@@ -0,0 +1,210 @@
+#include "parthink.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "level.h"
+#include "think.h"
+
+// regions are REGION_BLOCKS square and colored in a 2x2 pattern.
+// a mobj moves less than a block per tic and no query reaches more than two blocks
+// past it, so two regions of the same color never touch the same block and can run at once
+#define REGION_BLOCKS 4
+#define NUM_PHASES 4
+
+typedef struct
+{
+    int nthinkers, maxthinkers;
+    thinker_t **thinkers;
+    levelfxqueue_t fx;
+} region_t;
+
+static int nthreads = 1;
+static int regionw = 0, regionh = 0;
+static region_t *regions = NULL;
+
+static pthread_mutex_t worklock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t workcond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t donecond = PTHREAD_COND_INITIALIZER;
+
+// current phase, guarded by worklock
+static int generation = 0;
+static int *phaseregions = NULL;
+static int nphaseregions = 0, nextregion = 0, nbusy = 0;
+static float phaseft, phaseprogtime;
+
+static void parthink_runregion(region_t* region)
+{
+    int i;
+
+    level_fxqueue = &region->fx;
+
+    // mobj thinkers never kill themselves, removals come back through the fx queue
+    for(i=0; i<region->nthinkers; i++)
+        region->thinkers[i]->func(region->thinkers[i], phaseft, phaseprogtime);
+
+    level_fxqueue = NULL;
+}
+
+// call with worklock held
+static void parthink_drain(void)
+{
+    region_t *region;
+
+    while(nextregion < nphaseregions)
+    {
+        region = &regions[phaseregions[nextregion++]];
+        nbusy++;
+
+        pthread_mutex_unlock(&worklock);
+        parthink_runregion(region);
+        pthread_mutex_lock(&worklock);
+
+        nbusy--;
+    }
+
+    if(!nbusy)
+        pthread_cond_signal(&donecond);
+}
+
+static void* parthink_worker(void* arg)
+{
+    int seen;
+
+    seen = 0;
+
+    pthread_mutex_lock(&worklock);
+    for(;;)
+    {
+        while(seen == generation)
+            pthread_cond_wait(&workcond, &worklock);
+        seen = generation;
+
+        parthink_drain();
+    }
+
+    return NULL;
+}
+
+static void parthink_runphase(int phase)
+{
+    int rx, ry;
+
+    region_t *region;
+
+    pthread_mutex_lock(&worklock);
+
+    nphaseregions = nextregion = 0;
+    for(ry=(phase>>1); ry<regionh; ry+=2)
+    {
+        for(rx=(phase&1); rx<regionw; rx+=2)
+        {
+            region = &regions[ry * regionw + rx];
+            if(region->nthinkers)
+                phaseregions[nphaseregions++] = ry * regionw + rx;
+        }
+    }
+
+    if(!nphaseregions)
+    {
+        pthread_mutex_unlock(&worklock);
+        return;
+    }
+
+    generation++;
+    pthread_cond_broadcast(&workcond);
+
+    parthink_drain();
+    while(nbusy || nextregion < nphaseregions)
+        pthread_cond_wait(&donecond, &worklock);
+
+    pthread_mutex_unlock(&worklock);
+}
+
+static void parthink_bucket(thinker_t* thinker, object_t* mobj)
+{
+    int b, rx, ry;
+
+    region_t *region;
+
+    b = mobj->blk - blockmap.blks;
+    rx = (b % blockmap.w) / REGION_BLOCKS;
+    ry = (b / blockmap.w) / REGION_BLOCKS;
+    region = &regions[ry * regionw + rx];
+
+    if(region->nthinkers >= region->maxthinkers)
+    {
+        region->maxthinkers = region->maxthinkers ? region->maxthinkers * 2 : 16;
+        region->thinkers = realloc(region->thinkers, region->maxthinkers * sizeof(thinker_t*));
+    }
+
+    region->thinkers[region->nthinkers++] = thinker;
+}
+
+void parthink_init(int threads)
+{
+    int i;
+
+    pthread_t worker;
+
+    nthreads = threads;
+    if(nthreads <= 1)
+        return;
+
+    regionw = (blockmap.w + REGION_BLOCKS - 1) / REGION_BLOCKS;
+    regionh = (blockmap.h + REGION_BLOCKS - 1) / REGION_BLOCKS;
+    regions = calloc(regionw * regionh, sizeof(region_t));
+    phaseregions = malloc(regionw * regionh * sizeof(int));
+
+    // the tic thread does work too
+    for(i=0; i<nthreads-1; i++)
+    {
+        pthread_create(&worker, NULL, parthink_worker, NULL);
+        pthread_detach(worker);
+    }
+}
+
+void parthink(float frametime, float progtime)
+{
+    int i;
+    thinker_t *thinker, *next;
+
+    object_t *mobj;
+
+    if(nthreads <= 1)
+    {
+        think(frametime, progtime);
+        return;
+    }
+
+    // players, sector movers and anything outside the blockmap run here in list order,
+    // everything else is bucketed by the region its block is in
+    for(thinker=thinkers; thinker; thinker=next)
+    {
+        next = thinker->next;
+
+        mobj = level_thinkermobj(thinker);
+        if(mobj && mobj->blk)
+        {
+            parthink_bucket(thinker, mobj);
+            continue;
+        }
+
+        if(!thinker->func(thinker, frametime, progtime))
+            continue;
+
+        freethinker(thinker);
+    }
+
+    phaseft = frametime;
+    phaseprogtime = progtime;
+    for(i=0; i<NUM_PHASES; i++)
+        parthink_runphase(i);
+
+    // merge in region order so the outcome doesn't depend on thread timing
+    for(i=0; i<regionw*regionh; i++)
+    {
+        level_applyfx(&regions[i].fx);
+        regions[i].nthinkers = 0;
+    }
+}
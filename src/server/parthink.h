@@ -0,0 +1,9 @@
+#ifndef _PARTHINK_H
+#define _PARTHINK_H
+
+// call after the level is loaded. nthreads <= 1 leaves parthink as a plain think
+void parthink_init(int nthreads);
+// same as think, but mobjs are advanced and moved on a worker pool
+void parthink(float frametime, float progtime);
+
+#endif
@@ -0,0 +1,172 @@
+#include "rate.h"
+
+#include "client.h"
+#include "doommath.h"
+#include "net.h"
+
+// conditions are looked at and the rate adjusted this often
+#define RATE_ADJUSTTICS TICRATE
+// never backs off below this many bytes per second
+#define RATE_MIN 4000
+// added each adjustment that sees no congestion
+#define RATE_STEP 2000
+#define RATE_BACKOFF 0.75f
+#define RATE_LOSSHIGH 0.1f
+#define RATE_LOSSLOW 0.02f
+// more than this waiting in the data channel means the link can't keep up
+#define RATE_BUFFEREDHIGH (64 * 1024)
+// tokens build up to at most this many snapshots' worth
+#define RATE_BURST 4
+#define RATE_MAXINTERVAL 8
+// how far back the netchan's ack bits reach
+#define RATE_ACKBITS 32
+
+int clientrate = 128000;
+int serverrate = 0;
+
+// the most this client may use, its share of the server's rate if that's capped
+static float rate_cap(void)
+{
+    int i;
+
+    int nconnected;
+
+    if(!serverrate)
+        return clientrate;
+
+    nconnected = 0;
+    for(i=0; i<MAX_CLIENT; i++)
+        if(clients[i].state == CLSTATE_CONNECTED)
+            nconnected++;
+
+    return MIN(clientrate, serverrate / MAX(nconnected, 1));
+}
+
+// the window of delta bases has to outlast a round trip, or every snapshot would be a full
+// update. a slow link gets fewer snapshots rather than that
+static int rate_mininterval(client_t* cl)
+{
+    netstats_t *stats;
+    int rtttics;
+
+    stats = &cl->chan.stats;
+    rtttics = (stats->rtt + 4 * stats->jitter) * TICRATE;
+    return MAX(snapshotinterval, 1 + rtttics / GAMESTATE_WINDOW);
+}
+
+void rate_reset(client_t* cl)
+{
+    ratectl_t *rc;
+
+    rc = &cl->rate;
+    rc->rate = rate_cap();
+    rc->tokens = 0;
+    rc->interval = snapshotinterval;
+    rc->nextsnaptic = ntics;
+    rc->loss = 0;
+    rc->throughput = 0;
+    rc->lastack = cl->chan.inack;
+    rc->ackedbytes = 0;
+    rc->adjusttic = ntics + RATE_ADJUSTTICS;
+    rc->congested = false;
+}
+
+// a snapshot arrived once the client acks it, directly or with an ack bit. it's lost once
+// the ack has moved past the ack bits without covering it
+static void rate_checkacks(client_t* cl)
+{
+    int i;
+
+    ratectl_t *rc;
+    bool lost;
+
+    rc = &cl->rate;
+    if(cl->chan.inack == rc->lastack)
+        return;
+
+    for(i=0; i<GAMESTATE_WINDOW; i++)
+    {
+        if(!cl->snapseqs[i] || cl->snapsettled[i] || cl->snapseqs[i] > cl->chan.inack)
+            continue;
+
+        lost = !netchan_acked(&cl->chan, cl->snapseqs[i]);
+        if(lost && cl->chan.inack - cl->snapseqs[i] <= RATE_ACKBITS)
+            continue;
+
+        cl->snapsettled[i] = true;
+        rc->loss = rc->loss * 0.9f + (lost ? 0.1f : 0);
+        if(!lost)
+            rc->ackedbytes += cl->snapbytes[i];
+    }
+
+    rc->lastack = cl->chan.inack;
+}
+
+static void rate_adjust(client_t* cl)
+{
+    ratectl_t *rc;
+    float cap;
+
+    rc = &cl->rate;
+    cap = rate_cap();
+
+    rc->throughput = rc->throughput * 0.5f + rc->ackedbytes * ((float) TICRATE / RATE_ADJUSTTICS) * 0.5f;
+    rc->ackedbytes = 0;
+
+    // back off hard, to what's actually getting through if that's lower
+    if(rc->congested || rc->loss > RATE_LOSSHIGH)
+    {
+        rc->rate *= RATE_BACKOFF;
+        if(rc->throughput > 0)
+            rc->rate = MIN(rc->rate, rc->throughput);
+        rc->interval = MIN(rc->interval * 2, RATE_MAXINTERVAL);
+    }
+    else if(rc->loss < RATE_LOSSLOW)
+    {
+        rc->rate += RATE_STEP;
+        rc->interval = MAX(rc->interval - 1, snapshotinterval);
+    }
+
+    rc->interval = MAX(rc->interval, rate_mininterval(cl));
+
+    rc->rate = CLAMP(rc->rate, MIN(RATE_MIN, cap), cap);
+    rc->congested = false;
+}
+
+bool rate_update(client_t* cl)
+{
+    ratectl_t *rc;
+
+    rc = &cl->rate;
+
+    rate_checkacks(cl);
+
+    if(ntics >= rc->adjusttic)
+    {
+        rate_adjust(cl);
+        rc->adjusttic = ntics + RATE_ADJUSTTICS;
+    }
+
+    rc->tokens = MIN(rc->tokens + rc->rate / TICRATE, rc->rate * rc->interval * RATE_BURST / TICRATE);
+
+    if(ntics < rc->nextsnaptic)
+        return false;
+
+    // whatever we send now would only queue up behind what's already waiting
+    if(net_buffered(cl->dc) > RATE_BUFFEREDHIGH)
+    {
+        rc->congested = true;
+        return false;
+    }
+
+    return rc->tokens > 0;
+}
+
+void rate_sent(client_t* cl, int len)
+{
+    ratectl_t *rc;
+
+    rc = &cl->rate;
+    rc->tokens -= len;
+    rc->nextsnaptic = ntics + rc->interval;
+}
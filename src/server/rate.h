@@ -0,0 +1,36 @@
+#ifndef _RATE_H
+#define _RATE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct client_s client_t;
+
+typedef struct
+{
+    float rate; // bytes per second we let ourselves send
+    float tokens; // bytes that can go out right now, negative after a big snapshot
+    int interval; // tics between snapshots
+    int nextsnaptic;
+
+    // estimated from which snapshots get acked
+    float loss; // fraction of snapshots that never get acked
+    float throughput; // bytes per second getting through
+    int32_t lastack;
+    int ackedbytes; // since the last adjustment
+    int adjusttic;
+    bool congested; // since the last adjustment
+} ratectl_t;
+
+// per client bytes per second cap
+extern int clientrate;
+// bytes per second for all clients together, 0 for no limit
+extern int serverrate;
+
+void rate_reset(client_t* cl);
+// call once a tic, returns true if a snapshot should go out to the client this tic
+bool rate_update(client_t* cl);
+// call after a snapshot of len bytes was sent
+void rate_sent(client_t* cl, int len);
+
+#endif
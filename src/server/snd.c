@@ -1,44 +1,140 @@
 #include "snd.h"
 
 #include "client.h"
+#include "level.h"
 #include "net.h"
 #include "packets.h"
+#include "svsnd.h"
 
-void snd_queueedict(int sfxid, int edict)
+// sound events go out in every snapshot until one carrying them is acked
+#define SND_EVENTS 256
+// a sound heard this late isn't worth playing
+#define SND_MAXAGE 17
+
+typedef struct
+{
+    int32_t seq;
+    int tic;
+    uint8_t sfxid;
+    uint8_t flags;
+    uint16_t edict;
+    float x, y;
+    sector_t *sector;
+} sndevent_t;
+
+int32_t sndseq = 0;
+
+static sndevent_t sndevents[SND_EVENTS];
+
+static sndevent_t* snd_newevent(int sfxid, float x, float y)
 {
-    int i;
+    sndevent_t *event;
+    ssector_t *ssector;
+
+    sndseq++;
+    event = &sndevents[sndseq % SND_EVENTS];
+    event->seq = sndseq;
+    event->tic = ntics;
+    event->sfxid = sfxid;
+    event->x = x;
+    event->y = y;
+
+    ssector = level_getpointssector(x, y);
+    event->sector = ssector ? ssector->sector : NULL;
 
-    netbuf_t buf;
-    
-    netbuf_init(&buf);
-    netbuf_writeu8(&buf, SVC_SOUND);
-    netbuf_writeu8(&buf, sfxid);
-    netbuf_writeu8(&buf, SND_HASEDICT);
-    netbuf_writeu16(&buf, edict);
+    return event;
+}
+
+void snd_queueedict(int sfxid, int edict)
+{
+    sndevent_t *event;
 
-    for(i=0; i<MAX_CLIENT; i++)
-        if(clients[i].state == CLSTATE_CONNECTED)
-            netchan_queue(&clients[i].chan, &buf);
+    if(level_fxqueue)
+    {
+        level_queuefx(level_fxqueue, LEVELFX_SOUND, &mobjs[edict], sfxid, NULL, NULL);
+        return;
+    }
 
-    netbuf_free(&buf);
+    event = snd_newevent(sfxid, mobjs[edict].info.x, mobjs[edict].info.y);
+    event->flags = SND_HASEDICT;
+    event->edict = edict;
 }
 
 void snd_queuepos(int sfxid, float x, float y)
 {
-    int i;
-
-    netbuf_t buf;
-    
-    netbuf_init(&buf);
-    netbuf_writeu8(&buf, SVC_SOUND);
-    netbuf_writeu8(&buf, sfxid);
-    netbuf_writeu8(&buf, SND_HASPOS);
-    netbuf_writefloat(&buf, x);
-    netbuf_writefloat(&buf, y);
-
-    for(i=0; i<MAX_CLIENT; i++)
-        if(clients[i].state == CLSTATE_CONNECTED)
-            netchan_queue(&clients[i].chan, &buf);
-
-    netbuf_free(&buf);
+    sndevent_t *event;
+
+    event = snd_newevent(sfxid, x, y);
+    event->flags = SND_HASPOS;
+}
+
+static bool snd_audible(client_t* cl, sndevent_t* event)
+{
+    object_t *listener;
+    float dx, dy;
+
+    listener = cl->player.mobj;
+    if(!listener || !listener->info.exists)
+        return true;
+
+    dx = event->x - listener->info.x;
+    dy = event->y - listener->info.y;
+    if(dx * dx + dy * dy >= SND_CLIPDIST * SND_CLIPDIST)
+        return false;
+
+    if(event->sector && listener->ssector && level_rejected(listener->ssector->sector, event->sector))
+        return false;
+
+    return true;
+}
+
+int32_t snd_writeevents(client_t* cl, netbuf_t* buf)
+{
+    int32_t i;
+
+    int32_t first;
+    int countpos, count;
+    sndevent_t *event;
+
+    first = MAX(cl->sndacked + 1, sndseq - SND_EVENTS + 1);
+
+    countpos = -1;
+    count = 0;
+    for(i=first; i<=sndseq && count<255; i++)
+    {
+        event = &sndevents[i % SND_EVENTS];
+        if(ntics - event->tic > SND_MAXAGE)
+            continue;
+        if(!snd_audible(cl, event))
+            continue;
+
+        // running out of room just leaves the rest for later, the snapshot is still good
+        if(!netbuf_fits(buf, 2 + 4 + 1 + 1 + 4 + 4))
+            break;
+        netbuf_reserve(buf, 2 + 4 + 1 + 1 + 4 + 4);
+
+        if(countpos < 0)
+        {
+            netbuf_putu8(buf, SVC_SOUNDEVENTS);
+            countpos = buf->len;
+            netbuf_putu8(buf, 0);
+        }
+
+        netbuf_putu32(buf, event->seq);
+        netbuf_putu8(buf, event->sfxid);
+        netbuf_putu8(buf, event->flags);
+        if(event->flags & SND_HASEDICT)
+            netbuf_putu16(buf, event->edict);
+        else
+        {
+            netbuf_putfloat(buf, event->x);
+            netbuf_putfloat(buf, event->y);
+        }
+        count++;
+    }
+
+    if(countpos >= 0)
+        buf->data[countpos] = count;
+
+    return i - 1;
 }
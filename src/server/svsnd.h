@@ -0,0 +1,15 @@
+#ifndef _SVSND_H
+#define _SVSND_H
+
+#include "client.h"
+#include "net.h"
+
+// newest sound event queued so far, events are numbered from 1
+extern int32_t sndseq;
+
+// writes an SVC_SOUNDEVENTS with every recent event after the one the client last acked
+// that it could plausibly hear. nothing is written if there are none.
+// returns the newest event covered, the rest wait for a later snapshot if buf fills up
+int32_t snd_writeevents(client_t* cl, netbuf_t* buf);
+
+#endif
@@ -3,10 +3,10 @@
 #include <assert.h>
 #include <string.h>
 
+#include "lagcomp.h"
 #include "level.h"
 #include "lineatk.h"
 #include "player.h"
-#include "rand.h"
 #include "snd.h"
 
 void A_FirePistol()
@@ -22,11 +22,14 @@ void A_FirePistol()
     snd_queueedict(sfx_pistol, edict);
     level_setmobjstate(curwpnplayer->mobj, S_PLAY_ATK2);
 
+    // aim and hit against what the shooter was looking at
+    lagcomp_rewind(curwpnplayer);
     angle = curwpnplayer->mobj->info.angle;
     slope = lineatk_findslope(curwpnplayer->mobj, curwpnplayer->mobj->info.angle);
     if(refiring)
-        angle += ((prand() - prand()) << 18);
-    lineatk(5 * (prand() % 3 + 1), curwpnplayer->mobj, angle, 2048, slope);
+        angle += ((player_rand(curwpnplayer) - player_rand(curwpnplayer)) << 18);
+    lineatk(5 * (player_rand(curwpnplayer) % 3 + 1), curwpnplayer->mobj, angle, 2048, slope);
+    lagcomp_restore();
 
     curwpnplayer->info.ammo[wpndefs[WEAPON_PIST].ammo]--;
 }
@@ -45,9 +48,11 @@ void A_FireShotgun()
     snd_queueedict(sfx_shotgn, edict);
     level_setmobjstate(curwpnplayer->mobj, S_PLAY_ATK2);
 
+    lagcomp_rewind(curwpnplayer);
     slope = lineatk_findslope(curwpnplayer->mobj, curwpnplayer->mobj->info.angle);
     for(i=0; i<7; i++)
-        lineatk(5 * (prand() % 3 + 1), curwpnplayer->mobj, curwpnplayer->mobj->info.angle + ((prand() - prand()) << 18), 2048, slope);
+        lineatk(5 * (player_rand(curwpnplayer) % 3 + 1), curwpnplayer->mobj, curwpnplayer->mobj->info.angle + ((player_rand(curwpnplayer) - player_rand(curwpnplayer)) << 18), 2048, slope);
+    lagcomp_restore();
 
     curwpnplayer->info.ammo[wpndefs[WEAPON_SHOT].ammo]--;
 }
@@ -65,11 +70,13 @@ void A_FireCGun()
     snd_queueedict(sfx_pistol, edict);
     level_setmobjstate(curwpnplayer->mobj, S_PLAY_ATK2);
 
+    lagcomp_rewind(curwpnplayer);
     angle = curwpnplayer->mobj->info.angle;
     slope = lineatk_findslope(curwpnplayer->mobj, curwpnplayer->mobj->info.angle);
     if(refiring)
-        angle += ((prand() - prand()) << 18);
-    lineatk(5 * (prand() % 3 + 1), curwpnplayer->mobj, angle, 2048, slope);
+        angle += ((player_rand(curwpnplayer) - player_rand(curwpnplayer)) << 18);
+    lineatk(5 * (player_rand(curwpnplayer) % 3 + 1), curwpnplayer->mobj, angle, 2048, slope);
+    lagcomp_restore();
 
     curwpnplayer->info.ammo[wpndefs[WEAPON_CHAIN].ammo]--;
 }
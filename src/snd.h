@@ -3,6 +3,9 @@
 
 #include "packets.h"
 
+// sounds this far from the listener are inaudible
+#define SND_CLIPDIST 1200.0f
+
 // sound enum taken from doom
 typedef enum
 {
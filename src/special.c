@@ -57,6 +57,7 @@ bool doorthink(doorthink_t* thinker, float ft, float progtime)
     {
     case 1:
         thinker->sector->ceilheight += thinker->speed * ft;
+        level_wakesector(thinker->sector);
 
         if(thinker->sector->ceilheight >= thinker->top)
         {
@@ -79,6 +80,7 @@ bool doorthink(doorthink_t* thinker, float ft, float progtime)
     case -1:
 
         thinker->sector->ceilheight -= thinker->speed * ft;
+        level_wakesector(thinker->sector);
 
         if(level_mobjstuckinsector(thinker->sector))
         {
@@ -113,6 +115,7 @@ bool platthink(platthink_t* thinker, float ft, float progtime)
     {
     case -1:
         thinker->sector->floorheight -= thinker->speed * ft;
+        level_wakesector(thinker->sector);
         if(thinker->sector->floorheight <= thinker->bottom)
         {
             thinker->state = 0;
@@ -134,6 +137,7 @@ bool platthink(platthink_t* thinker, float ft, float progtime)
         return false;
     case 1:
         thinker->sector->floorheight += thinker->speed * ft;
+        level_wakesector(thinker->sector);
 
         if(thinker->sector->floorheight >= thinker->top)
         {
@@ -168,6 +172,7 @@ bool floorthink(floorthink_t* thinker, float ft, float progtime)
     }
     
     thinker->sector->floorheight -= thinker->speed * ft;
+    level_wakesector(thinker->sector);
     if(thinker->sector->floorheight <= thinker->bottom)
     {
         thinker->sector->floorheight = thinker->bottom;
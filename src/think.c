@@ -3,6 +3,34 @@
 #include <stdlib.h>
 
 thinker_t* thinkers = NULL;
+thinker_t* sleepers = NULL;
+
+static void linkthinker(thinker_t* thinker, thinker_t** list)
+{
+    thinker->prev = NULL;
+    if(*list)
+        (*list)->prev = thinker;
+    thinker->next = *list;
+    *list = thinker;
+}
+
+static void unlinkthinker(thinker_t* thinker)
+{
+    thinker_t **list;
+    thinker_t *prev, *next;
+
+    list = thinker->asleep ? &sleepers : &thinkers;
+
+    prev = thinker->prev;
+    next = thinker->next;
+
+    if(prev)
+        prev->next = next;
+    if(next)
+        next->prev = prev;
+    if(thinker == *list)
+        *list = next;
+}
 
 void think(float frametime, float progtime)
 {
@@ -22,29 +50,36 @@ void think(float frametime, float progtime)
 
 void addthinker(thinker_t* thinker)
 {
-    thinker->prev = NULL;
-    if(thinkers)
-        thinkers->prev = thinker;
-    thinker->next = thinkers;
-    thinkers = thinker;
+    thinker->asleep = false;
+    linkthinker(thinker, &thinkers);
 }
 
 void freethinker(thinker_t* thinker)
 {
-    thinker_t *prev, *next;
-    
-    prev = thinker->prev;
-    next = thinker->next;
-
-    if(prev)
-        prev->next = next;
-    if(next)
-        next->prev = prev;
-    if(thinker == thinkers)
-        thinkers = next;
+    unlinkthinker(thinker);
 
     if(thinker->freefunc)
         thinker->freefunc(thinker);
     
     free(thinker);
 }
+
+void sleepthinker(thinker_t* thinker)
+{
+    if(thinker->asleep)
+        return;
+
+    unlinkthinker(thinker);
+    thinker->asleep = true;
+    linkthinker(thinker, &sleepers);
+}
+
+void wakethinker(thinker_t* thinker)
+{
+    if(!thinker->asleep)
+        return;
+
+    unlinkthinker(thinker);
+    thinker->asleep = false;
+    linkthinker(thinker, &thinkers);
+}
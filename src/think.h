@@ -14,12 +14,18 @@ struct thinker_s
     thinkfunc_t func;
     thinkfreefunc_t freefunc;
     thinker_t *prev, *next;
+    bool asleep; // on the sleepers list instead of thinkers
 };
 
 extern thinker_t* thinkers;
+// thinkers that have nothing to do until something wakes them
+extern thinker_t* sleepers;
 
 void think(float frametime, float progtime);
 void addthinker(thinker_t* thinker);
 void freethinker(thinker_t* thinker);
+// moves a thinker between the active and sleeping lists. safe on the thinker currently running
+void sleepthinker(thinker_t* thinker);
+void wakethinker(thinker_t* thinker);
 
 #endif
\ No newline at end of file